@@ -426,6 +426,7 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     luaC_checkGC(L);
     o = index2value(L, idx);  /* previous call may reallocate the stack */
   }
+  luaS_fixcstr(L, tsvalue(o));  /* its contents will be a C string */
   lua_unlock(L);
   if (len != NULL)
     return getlstr(tsvalue(o), *len);
@@ -1240,6 +1241,15 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
         g->gcparams[param] = luaO_codeparam(cast_uint(value));
       break;
     }
+    case LUA_GCSTATS: {
+      int total = va_arg(argp, int);
+      lua_Integer *stats = va_arg(argp, lua_Integer *);
+      const lua_Integer *src = total ? g->gcstats.total : g->gcstats.last;
+      int i;
+      for (i = 0; i < LUA_GCSN; i++)
+        stats[i] = src[i];
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1057,6 +1057,139 @@ void *luaL_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 
+/*
+** {======================================================
+** Pool allocator
+** Small blocks come from free lists, one for each size class; new
+** blocks for a class are carved from big chunks obtained with
+** 'malloc'. Larger blocks use 'realloc' and 'free'. Lua always gives
+** the size of a block being freed or reallocated, so blocks need no
+** headers. Most core objects (tables, short strings, upvalues,
+** closures, small node arrays) fall into the small classes. Memory
+** from chunks is reused only for blocks of the same class, and it is
+** released only by 'luaL_closepool'.
+** =======================================================
+*/
+
+/* size classes are multiples of this (which must ensure alignment) */
+#define POOLGRAIN	16
+
+/* maximum size of a block from a size class */
+#if !defined(LUAL_POOLMAX)
+#define LUAL_POOLMAX	256
+#endif
+
+/* size of each chunk */
+#if !defined(LUAL_POOLCHUNK)
+#define LUAL_POOLCHUNK	(64 * 1024)
+#endif
+
+#define NPOOLCLASSES	(LUAL_POOLMAX / POOLGRAIN)
+
+/* size class for a block with 'sz' bytes (sz > 0) */
+#define poolclass(sz)	cast_int(((sz) - 1) / POOLGRAIN)
+
+
+typedef union PoolBlock {
+  union PoolBlock *next;  /* free blocks form a list */
+  LUAI_MAXALIGN;  /* ensures maximum alignment for chunks */
+} PoolBlock;
+
+
+struct luaL_Pool {
+  PoolBlock *freelist[NPOOLCLASSES];  /* free blocks for each class */
+  char *next;  /* free space in the current chunk */
+  char *limit;  /* end of the current chunk */
+  PoolBlock *chunks;  /* list of all chunks */
+};
+
+
+LUALIB_API luaL_Pool *luaL_newpool (void) {
+  luaL_Pool *pool = (luaL_Pool *)malloc(sizeof(luaL_Pool));
+  if (pool != NULL) {
+    int i;
+    for (i = 0; i < NPOOLCLASSES; i++)
+      pool->freelist[i] = NULL;
+    pool->next = pool->limit = NULL;
+    pool->chunks = NULL;
+  }
+  return pool;
+}
+
+
+LUALIB_API void luaL_closepool (luaL_Pool *pool) {
+  PoolBlock *c = pool->chunks;
+  while (c != NULL) {
+    PoolBlock *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(pool);
+}
+
+
+static void *poolnew (luaL_Pool *pool, size_t size) {
+  int c = poolclass(size);
+  PoolBlock *b = pool->freelist[c];
+  if (b != NULL) {  /* reuse a free block? */
+    pool->freelist[c] = b->next;
+    return b;
+  }
+  size = cast_sizet(c + 1) * POOLGRAIN;  /* size of its class */
+  if (cast_sizet(pool->limit - pool->next) < size) {  /* chunk is full? */
+    PoolBlock *chunk = (PoolBlock *)malloc(LUAL_POOLCHUNK);
+    if (chunk == NULL)
+      return NULL;
+    chunk->next = pool->chunks;  /* link new chunk */
+    pool->chunks = chunk;
+    pool->next = (char *)chunk + POOLGRAIN;  /* skip link */
+    pool->limit = (char *)chunk + LUAL_POOLCHUNK;
+  }
+  b = (PoolBlock *)pool->next;
+  pool->next += size;
+  return b;
+}
+
+
+static void poolfree (luaL_Pool *pool, void *ptr, size_t size) {
+  PoolBlock *b = (PoolBlock *)ptr;
+  int c = poolclass(size);
+  b->next = pool->freelist[c];
+  pool->freelist[c] = b;
+}
+
+
+LUALIB_API void *luaL_poolalloc (void *ud, void *ptr, size_t osize,
+                                            size_t nsize) {
+  luaL_Pool *pool = (luaL_Pool *)ud;
+  if (ptr == NULL)  /* new block? ('osize' is not a size) */
+    osize = 0;
+  if (nsize == 0) {  /* free block? */
+    if (osize > LUAL_POOLMAX)
+      free(ptr);
+    else if (ptr != NULL)
+      poolfree(pool, ptr, osize);
+    return NULL;
+  }
+  else if (osize > LUAL_POOLMAX && nsize > LUAL_POOLMAX)
+    return realloc(ptr, nsize);  /* large block remains large */
+  else if (osize > 0 && osize <= LUAL_POOLMAX && nsize <= LUAL_POOLMAX &&
+           poolclass(osize) == poolclass(nsize))
+    return ptr;  /* block already has the right size */
+  else {  /* move block to a new place */
+    void *newblock = (nsize > LUAL_POOLMAX) ? malloc(nsize)
+                                            : poolnew(pool, nsize);
+    if (newblock != NULL && ptr != NULL) {
+      memcpy(newblock, ptr, (osize < nsize) ? osize : nsize);
+      luaL_poolalloc(ud, ptr, osize, 0);  /* free old block */
+    }
+    return newblock;
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** Standard panic function just prints an error message. The test
 ** with 'lua_type' avoids possible memory errors in 'lua_tostring'.
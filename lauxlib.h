@@ -84,6 +84,13 @@ LUALIB_API int (luaL_execresult) (lua_State *L, int stat);
 LUALIB_API void *(luaL_alloc) (void *ud, void *ptr, size_t osize,
                                                     size_t nsize);
 
+typedef struct luaL_Pool luaL_Pool;
+
+LUALIB_API luaL_Pool *(luaL_newpool) (void);
+LUALIB_API void (luaL_closepool) (luaL_Pool *pool);
+LUALIB_API void *(luaL_poolalloc) (void *ud, void *ptr, size_t osize,
+                                                        size_t nsize);
+
 
 /* predefined references */
 #define LUA_NOREF       (-2)
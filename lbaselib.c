@@ -193,6 +193,26 @@ static int pushmode (lua_State *L, int oldmode) {
 }
 
 
+/*
+** Push a table with the garbage-collection statistics in 'stats'.
+** Times are converted from microseconds to seconds.
+*/
+static void pushgcstats (lua_State *L, const lua_Integer *stats) {
+  static const char *const names[] = {
+    "propagate", "atomic", "sweep", "callfin", "maxstep",
+    "marked", "swept", "freed", "major", "minor"};
+  int i;
+  lua_createtable(L, 0, LUA_GCSN + 1);
+  for (i = 0; i < LUA_GCSN; i++) {
+    if (i <= LUA_GCSMAXSTEP)
+      lua_pushnumber(L, (lua_Number)stats[i] / 1e6);
+    else
+      lua_pushinteger(L, stats[i]);
+    lua_setfield(L, -2, names[i]);
+  }
+}
+
+
 /*
 ** check whether call to 'lua_gc' was valid (not inside a finalizer)
 */
@@ -201,10 +221,10 @@ static int pushmode (lua_State *L, int oldmode) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "isrunning", "generational", "incremental",
-    "param", NULL};
+    "param", "stats", NULL};
   static const char optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC,
-    LUA_GCPARAM};
+    LUA_GCPARAM, LUA_GCSTATS};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   switch (o) {
     case LUA_GCCOUNT: {
@@ -236,15 +256,25 @@ static int luaB_collectgarbage (lua_State *L) {
     case LUA_GCPARAM: {
       static const char *const params[] = {
         "minormul", "majorminor", "minormajor",
-        "pause", "stepmul", "stepsize", NULL};
+        "pause", "stepmul", "stepsize", "steptime", NULL};
       static const char pnum[] = {
         LUA_GCPMINORMUL, LUA_GCPMAJORMINOR, LUA_GCPMINORMAJOR,
-        LUA_GCPPAUSE, LUA_GCPSTEPMUL, LUA_GCPSTEPSIZE};
+        LUA_GCPPAUSE, LUA_GCPSTEPMUL, LUA_GCPSTEPSIZE, LUA_GCPSTEPTIME};
       int p = pnum[luaL_checkoption(L, 2, NULL, params)];
       lua_Integer value = luaL_optinteger(L, 3, -1);
       lua_pushinteger(L, lua_gc(L, o, p, (int)value));
       return 1;
     }
+    case LUA_GCSTATS: {
+      lua_Integer last[LUA_GCSN], total[LUA_GCSN];
+      int res = lua_gc(L, o, 0, last);
+      checkvalres(res);
+      lua_gc(L, o, 1, total);
+      pushgcstats(L, last);
+      pushgcstats(L, total);
+      lua_setfield(L, -2, "total");
+      return 1;
+    }
     default: {
       int res = lua_gc(L, o);
       checkvalres(res);
@@ -14,12 +14,14 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 
 #include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
+#include "lfunc.h"
 #include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
@@ -869,6 +871,10 @@ void luaK_dischargevars (FuncState *fs, expdesc *e) {
       luaK_setoneret(fs, e);
       break;
     }
+    case VINLINE: {  /* result already in its register */
+      e->k = VNONRELOC;
+      break;
+    }
     default: break;  /* there is one value available (somewhere) */
   }
 }
@@ -1652,6 +1658,7 @@ static void codeorder (FuncState *fs, BinOpr opr, expdesc *e1, expdesc *e2) {
     r1 = luaK_exp2anyreg(fs, e1);
     r2 = luaK_exp2anyreg(fs, e2);
     op = binopr2op(opr, OPR_LT, OP_LT);
+    isfloat = 0;  /* C is not used by register comparisons */
   }
   freeexps(fs, e1, e2);
   e1->u.info = condjump(fs, op, r1, r2, isfloat, 1);
@@ -1969,3 +1976,1021 @@ void luaK_finish (FuncState *fs) {
     }
   }
 }
+
+
+/*
+** {======================================================
+** Inlining of calls to small read-only local functions (see
+** 'funcargs' in lparser.c). The code of the callee, already finished,
+** is copied into the caller with its registers moved to the call's
+** argument area, its upvalues turned into the caller's variables, and
+** its constants added to the caller's constants.
+** =======================================================
+*/
+
+/* maximum size (in instructions) of an inlined function */
+#define MAXINLINE	16
+
+
+#if defined(LUAI_INLINEDEBUG)
+#include <stdio.h>
+
+/* report inlined calls in 'stderr' */
+static void reportinline (FuncState *fs, const Proto *p, int line) {
+  lua_State *L = fs->ls->L;
+  char buff[LUA_IDSIZE];
+  const char *msg;
+  luaO_chunkid(buff, getstr(fs->ls->source), tsslen(fs->ls->source));
+  msg = luaO_pushfstring(L, "%s:%d: inlined call to function at line %d\n",
+                            buff, line, p->linedefined);
+  lua_writestringerror("%s", msg);
+  L->top.p--;  /* remove message */
+}
+#else
+#define reportinline(fs,p,line)	UNUSED(line)
+#endif
+
+
+/*
+** Add constant 'k' of inlined function 'p' to the current function
+** and return its new index. When 'fs' is NULL, only return 0 (see
+** 'luaK_inline'). 'luaK_inline' ensures that the index fits in the
+** instruction argument.
+*/
+static int inlineK (FuncState *fs, const Proto *p, int k) {
+  const TValue *v = &p->k[k];
+  int nk;
+  if (fs == NULL)  /* only checking? */
+    return 0;
+  switch (ttypetag(v)) {
+    case LUA_VSHRSTR: case LUA_VLNGSTR: nk = stringK(fs, tsvalue(v)); break;
+    case LUA_VNUMINT: nk = luaK_intK(fs, ivalue(v)); break;
+    case LUA_VNUMFLT: nk = luaK_numberK(fs, fltvalue(v)); break;
+    case LUA_VFALSE: nk = boolF(fs); break;
+    case LUA_VTRUE: nk = boolT(fs); break;
+    default: lua_assert(ttisnil(v)); nk = nilK(fs); break;
+  }
+  lua_assert(nk <= MAXARG_B && nk <= MAXARG_C);
+  return nk;
+}
+
+
+/*
+** Translate instruction 'i' from inlined function 'p' into '*res', to
+** run with the registers of 'p' starting at register 'base'. Return
+** false if it cannot be translated. Only instructions that keep to
+** their own registers and that continue to the next instruction or
+** jump inside the code are accepted. With a NULL 'fs', only check
+** the instruction, without adding its constants to any function.
+*/
+static int inlineinstr (FuncState *fs, const Proto *p, Instruction i,
+                        int base, Instruction *res) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i) + base;
+  int b, c;
+  switch (op) {
+    case OP_JMP:
+      break;
+    case OP_LOADI: case OP_LOADF: case OP_LOADFALSE: case OP_LFALSESKIP:
+    case OP_LOADTRUE: case OP_LOADNIL: case OP_CONCAT: case OP_EQI:
+    case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI: case OP_TEST:
+    case OP_MMBINI: case OP_CALL: case OP_FORLOOP: case OP_FORPREP:
+      SETARG_A(i, a);
+      break;
+    case OP_MOVE: case OP_GETI: case OP_ADDI: case OP_SHLI: case OP_SHRI:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN: case OP_MMBIN:
+    case OP_EQ: case OP_LT: case OP_LE: case OP_TESTSET:
+      SETARG_A(i, a);
+      SETARG_B(i, GETARG_B(i) + base);
+      break;
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      SETARG_A(i, a);
+      SETARG_B(i, GETARG_B(i) + base);
+      SETARG_C(i, GETARG_C(i) + base);
+      break;
+    case OP_GETFIELD: case OP_SELF: case OP_ADDK: case OP_SUBK:
+    case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK: case OP_IDIVK:
+    case OP_BANDK: case OP_BORK: case OP_BXORK:  /* constant in C */
+      SETARG_A(i, a);
+      SETARG_B(i, GETARG_B(i) + base);
+      SETARG_C(i, inlineK(fs, p, GETARG_C(i)));
+      break;
+    case OP_EQK: case OP_MMBINK:  /* constant in B */
+      SETARG_A(i, a);
+      SETARG_B(i, inlineK(fs, p, GETARG_B(i)));
+      break;
+    case OP_LOADK:
+      SETARG_A(i, a);
+      SETARG_Bx(i, inlineK(fs, p, GETARG_Bx(i)));
+      break;
+    case OP_SETTABLE: case OP_SETI: case OP_SETFIELD: {
+      b = GETARG_B(i);  /* key: register, integer, or constant */
+      if (op == OP_SETTABLE)
+        b += base;
+      else if (op == OP_SETFIELD)
+        b = inlineK(fs, p, b);
+      c = GETARG_k(i) ? inlineK(fs, p, GETARG_C(i)) : GETARG_C(i) + base;
+      SETARG_A(i, a);
+      SETARG_B(i, b);
+      SETARG_C(i, c);
+      break;
+    }
+    case OP_GETUPVAL: case OP_SETUPVAL: {
+      const Upvaldesc *up = &p->upvalues[GETARG_B(i)];
+      if (!up->instack)  /* upvalue of the caller? */
+        i = CREATE_ABCk(op, a, up->idx, 0, 0);
+      else if (op == OP_GETUPVAL)  /* local variable of the caller */
+        i = CREATE_ABCk(OP_MOVE, a, up->idx, 0, 0);
+      else
+        i = CREATE_ABCk(OP_MOVE, up->idx, a, 0, 0);
+      break;
+    }
+    case OP_GETTABUP: {
+      const Upvaldesc *up = &p->upvalues[GETARG_B(i)];
+      i = CREATE_ABCk(up->instack ? OP_GETFIELD : OP_GETTABUP,
+                      a, up->idx, inlineK(fs, p, GETARG_C(i)), 0);
+      break;
+    }
+    case OP_SETTABUP: {
+      const Upvaldesc *up = &p->upvalues[GETARG_A(i)];
+      int k = GETARG_k(i);
+      c = k ? inlineK(fs, p, GETARG_C(i)) : GETARG_C(i) + base;
+      b = inlineK(fs, p, GETARG_B(i));
+      i = CREATE_ABCk(up->instack ? OP_SETFIELD : OP_SETTABUP,
+                      up->idx, b, c, k);
+      break;
+    }
+    default:
+      return 0;
+  }
+  *res = i;
+  return 1;
+}
+
+
+/*
+** Check whether function 'p' can be inlined: it must be a small
+** non-vararg function without nested functions, whose code ends with
+** its only return, of exactly one value. (Its final OP_RETURN0 is not
+** reachable.) All jumps must stay before that final OP_RETURN0.
+*/
+static int caninline (const Proto *p) {
+  int n = p->sizecode;
+  int pc;
+  if (isvararg(p) || p->sizep > 0 || n < 2 || n - 1 > MAXINLINE ||
+      GET_OPCODE(p->code[n - 1]) != OP_RETURN0 ||
+      GET_OPCODE(p->code[n - 2]) != OP_RETURN1)
+    return 0;
+  for (pc = 0; pc < n - 2; pc++) {
+    Instruction i = p->code[pc];
+    switch (GET_OPCODE(i)) {
+      case OP_JMP:
+        if (pc + 1 + GETARG_sJ(i) >= n - 1)
+          return 0;
+        break;
+      case OP_FORPREP:
+        if (pc + GETARG_Bx(i) + 2 >= n - 1)
+          return 0;
+        break;
+      default: break;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Load the function in register 'freg' into register 'base' of a call
+** whose arguments are already coded (a call that was not inlined). An
+** open last argument must stay right before the call that uses its
+** results, so the move goes before it.
+*/
+void luaK_loadfunc (FuncState *fs, int base, int freg, int nparams) {
+  if (nparams == LUA_MULTRET) {  /* last argument is open? */
+    Instruction last = fs->f->code[fs->pc - 1];
+    int line = fs->previousline;  /* line of that argument */
+    removelastinstruction(fs);
+    luaK_codeABC(fs, OP_MOVE, base, freg, 0);
+    luaK_code(fs, last);
+    luaK_fixline(fs, line);
+  }
+  else
+    luaK_codeABC(fs, OP_MOVE, base, freg, 0);
+}
+
+
+/*
+** Try to inline a call to function 'p' with 'nparams' arguments
+** already in the registers after 'base', leaving its result in 'base'.
+** Return false (generating no code) if the call cannot be inlined.
+*/
+int luaK_inline (FuncState *fs, const Proto *p, int base, int nparams,
+                 int line) {
+  int n, pc;
+  Instruction i;
+  if (p == NULL || !caninline(p) ||
+      base + 1 + p->maxstacksize > MAX_FSTACK)
+    return 0;
+  n = p->sizecode - 1;  /* code without final OP_RETURN0 */
+  /* each instruction uses at most two constants, and all of them must
+     fit in B and C arguments; so, new constants cannot go beyond
+     'fs->nk + 2 * (n - 1) - 1' */
+  if (fs->nk + 2 * (n - 1) > MAXARG_C + 1)
+    return 0;
+  lua_assert(MAXARG_B == MAXARG_C);
+  for (pc = 0; pc < n - 1; pc++) {  /* check all instructions first */
+    if (!inlineinstr(NULL, p, p->code[pc], base + 1, &i))
+      return 0;  /* no constants were added to 'fs' */
+  }
+  if (p->maxstacksize > nparams)
+    luaK_reserveregs(fs, p->maxstacksize - nparams);
+  if (nparams < p->numparams)  /* missing arguments? */
+    luaK_nil(fs, base + 1 + nparams, p->numparams - nparams);
+  for (pc = 0; pc < n - 1; pc++) {
+    inlineinstr(fs, p, p->code[pc], base + 1, &i);
+    luaK_code(fs, i);
+    luaK_fixline(fs, luaG_getfuncline(p, pc));
+  }
+  /* final return becomes a move of its value to 'base' */
+  luaK_codeABC(fs, OP_MOVE, base, GETARG_A(p->code[n - 1]) + base + 1, 0);
+  luaK_fixline(fs, luaG_getfuncline(p, n - 1));
+  luaK_getlabel(fs);  /* its code may have jumps to that move */
+  reportinline(fs, p, line);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Bytecode optimizer: an optional pass over a finished prototype
+** (see 'luaK_optimize'). All transformations are conservative:
+** when in doubt about some instruction, they leave the code alone.
+** =======================================================
+*/
+
+/* maximum number of instructions visited when checking liveness */
+#define MAXLIVESCAN	64
+
+/* maximum distance from a copied value to its move */
+#define MAXCOPYDIST	8
+
+
+/*
+** Check whether instruction 'i' may read register 'reg'. (Unknown
+** instructions are assumed to read all registers.)
+*/
+static int readsreg (const Proto *f, Instruction i, int reg) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE:
+    case OP_LOADNIL: case OP_GETUPVAL: case OP_GETTABUP:
+    case OP_NEWTABLE: case OP_NEWTABLEP: case OP_JMP: case OP_RETURN0:
+    case OP_VARARGPREP: case OP_EXTRAARG:
+      return 0;
+    case OP_MOVE: case OP_GETI: case OP_GETFIELD: case OP_SELF:
+    case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK:
+    case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK:
+    case OP_BXORK: case OP_SHLI: case OP_SHRI: case OP_UNM: case OP_BNOT:
+    case OP_NOT: case OP_LEN: case OP_TESTSET:
+      return (reg == GETARG_B(i));
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR: case OP_GETVARG:
+      return (reg == GETARG_B(i) || reg == GETARG_C(i));
+    case OP_SETUPVAL: case OP_MMBINI: case OP_MMBINK: case OP_TBC:
+    case OP_EQK: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI:
+    case OP_GEI: case OP_TEST: case OP_RETURN1: case OP_ERRNNIL:
+      return (reg == a);
+    case OP_MMBIN: case OP_EQ: case OP_LT: case OP_LE:
+      return (reg == a || reg == GETARG_B(i));
+    case OP_SETTABUP:
+      return (!GETARG_k(i) && reg == GETARG_C(i));
+    case OP_SETTABLE:
+      if (reg == GETARG_B(i)) return 1;
+      /* FALLTHROUGH */
+    case OP_SETI: case OP_SETFIELD:
+      return (reg == a || (!GETARG_k(i) && reg == GETARG_C(i)));
+    case OP_CONCAT:
+      return (a <= reg && reg < a + GETARG_B(i));
+    case OP_CALL: case OP_TAILCALL: {  /* function plus B - 1 arguments */
+      int b = GETARG_B(i);
+      return (a <= reg && (b == 0 || reg < a + b));
+    }
+    case OP_RETURN: {  /* B - 1 values */
+      int b = GETARG_B(i);
+      return (a <= reg && (b == 0 || reg < a + b - 1));
+    }
+    case OP_SETLIST: {
+      int b = GETARG_vB(i);
+      return (a <= reg && (b == 0 || reg <= a + b));
+    }
+    case OP_CLOSE:  /* may call '__close' metamethods */
+      return (a <= reg);
+    case OP_FORLOOP: case OP_FORPREP:
+      return (a <= reg && reg <= a + 2);
+    case OP_TFORPREP: case OP_TFORCALL: case OP_TFORLOOP:
+      return (a <= reg && reg <= a + 3);
+    case OP_VARARG:  /* may read the vararg table */
+      return (GETARG_k(i) && reg == GETARG_B(i));
+    case OP_CLOSURE: {  /* reads the registers it captures */
+      const Proto *p = f->p[GETARG_Bx(i)];
+      int u;
+      for (u = 0; u < p->sizeupvalues; u++) {
+        if (p->upvalues[u].instack && p->upvalues[u].idx == reg)
+          return 1;
+      }
+      return 0;
+    }
+    default: return 1;
+  }
+}
+
+
+/*
+** Check whether instruction 'i' surely sets register 'reg' (when it
+** completes).
+*/
+static int setsreg (Instruction i, int reg) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADKX: case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE:
+    case OP_GETUPVAL: case OP_GETTABUP: case OP_GETTABLE: case OP_GETI:
+    case OP_GETFIELD: case OP_NEWTABLE: case OP_NEWTABLEP: case OP_ADDI:
+    case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK: case OP_SHLI:
+    case OP_SHRI: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR: case OP_UNM: case OP_BNOT:
+    case OP_NOT: case OP_LEN: case OP_CONCAT: case OP_CLOSURE:
+    case OP_GETVARG:
+      return (reg == a);
+    case OP_LOADNIL:
+      return (a <= reg && reg <= a + GETARG_B(i));
+    case OP_SELF:
+      return (reg == a || reg == a + 1);
+    case OP_CALL: case OP_VARARG: {  /* C - 1 results */
+      int c = GETARG_C(i);
+      return (c > 0 && a <= reg && reg <= a + c - 2);
+    }
+    default: return 0;
+  }
+}
+
+
+/*
+** Check whether instruction 'i' may change register 'reg'. (Unknown
+** instructions are assumed to change all registers.)
+*/
+static int maysetreg (const Proto *f, Instruction i, int reg) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_SETUPVAL: case OP_SETTABUP: case OP_SETTABLE: case OP_SETI:
+    case OP_SETFIELD: case OP_MMBIN: case OP_MMBINI: case OP_MMBINK:
+    case OP_JMP: case OP_EQ: case OP_LT: case OP_LE: case OP_EQK:
+    case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+    case OP_TEST: case OP_RETURN: case OP_RETURN0: case OP_RETURN1:
+    case OP_TAILCALL: case OP_SETLIST: case OP_ERRNNIL: case OP_CLOSE:
+    case OP_TBC: case OP_VARARGPREP: case OP_EXTRAARG:
+      return 0;  /* ('MMBIN' sets the result of the previous opcode) */
+    case OP_TESTSET:
+      return (reg == a);
+    case OP_CALL: case OP_VARARG:
+      if (GETARG_C(i) == 0)  /* multiple results? */
+        return (a <= reg);
+      /* else */ return setsreg(i, reg);
+    case OP_FORLOOP: case OP_FORPREP:
+      return (a <= reg && reg <= a + 2);
+    case OP_TFORPREP:
+      return (reg == a + 2 || reg == a + 3);
+    case OP_TFORCALL:  /* also uses the registers after its results */
+      return (a + 3 <= reg);
+    case OP_CLOSURE:  /* a captured register may change through upvalue */
+      return (reg == a || readsreg(f, i, reg));
+    default:
+      if (setsreg(i, a))  /* instruction with known results? */
+        return setsreg(i, reg);
+      else
+        return 1;  /* unknown instruction */
+  }
+}
+
+
+/*
+** Check whether register 'reg' is dead at instruction 'pc', that is,
+** whether no path from 'pc' uses its current value. The search visits
+** at most '*budget' instructions; when that is not enough, the
+** register is assumed to be alive.
+*/
+static int regdead (const Proto *f, const lu_byte *removed, int pc,
+                    int reg, int *budget) {
+  for (; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    if (removed[pc])
+      continue;
+    if (--(*budget) < 0 || readsreg(f, i, reg))
+      return 0;
+    else if (setsreg(i, reg))
+      return 1;
+    switch (op) {
+      case OP_RETURN: case OP_RETURN0: case OP_RETURN1: case OP_TAILCALL:
+        return 1;
+      case OP_JMP:
+        pc += GETARG_sJ(i);
+        break;
+      case OP_LFALSESKIP:
+        pc++;  /* skip next instruction */
+        break;
+      case OP_TFORPREP:
+        pc += GETARG_Bx(i);
+        break;
+      case OP_FORPREP:  /* may skip the loop */
+        if (!regdead(f, removed, pc + 2 + GETARG_Bx(i), reg, budget))
+          return 0;
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:  /* may jump back */
+        if (!regdead(f, removed, pc + 1 - GETARG_Bx(i), reg, budget))
+          return 0;
+        break;
+      default:
+        if (testTMode(op) && !regdead(f, removed, pc + 2, reg, budget))
+          return 0;  /* path that skips the jump uses 'reg' */
+        break;
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Mark the instructions that can be reached by a jump (or a skip).
+*/
+static void marktargets (const Proto *f, lu_byte *target) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    int dest;
+    switch (op) {
+      case OP_JMP:
+        dest = pc + 1 + GETARG_sJ(i);
+        break;
+      case OP_FORPREP:
+        target[pc + 2 + GETARG_Bx(i)] = 1;  /* loop exit */
+        /* FALLTHROUGH */
+      case OP_TFORPREP:
+        dest = pc + 1 + GETARG_Bx(i);
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        dest = pc + 1 - GETARG_Bx(i);
+        break;
+      case OP_LFALSESKIP:
+        dest = pc + 2;
+        break;
+      default:
+        if (!testTMode(op))
+          continue;
+        dest = pc + 2;  /* test may skip its jump */
+        break;
+    }
+    target[dest] = 1;
+  }
+}
+
+
+/*
+** Check whether the instruction at 'pc' may be skipped by the previous
+** one, so that it cannot be removed or replaced. (Tests must be
+** followed by their jumps, and OP_LFALSESKIP skips its next
+** instruction.)
+*/
+static int isskipped (const Proto *f, const lu_byte *removed, int pc) {
+  while (--pc >= 0 && removed[pc])
+    ;
+  if (pc < 0)
+    return 0;
+  else {
+    OpCode op = GET_OPCODE(f->code[pc]);
+    return (testTMode(op) || op == OP_LFALSESKIP);
+  }
+}
+
+
+/*
+** Return the index of integer constant 'n' in 'f', adding it if
+** needed.
+*/
+static int intconstant (lua_State *L, Proto *f, lua_Integer n) {
+  int nk = f->sizek;
+  int oldsize = f->sizek;
+  int idx;
+  for (idx = 0; idx < nk; idx++) {
+    if (ttisinteger(&f->k[idx]) && ivalue(&f->k[idx]) == n)
+      return idx;
+  }
+  luaM_growvector(L, f->k, nk, f->sizek, TValue, MAXARG_Ax, "constants");
+  while (oldsize < f->sizek)
+    setnilvalue(&f->k[oldsize++]);
+  setivalue(&f->k[nk], n);
+  luaM_shrinkvector(L, f->k, f->sizek, nk + 1, TValue);
+  return nk;
+}
+
+
+/*
+** Check whether register 'reg' surely has an integer when instruction
+** 'pc' starts: the last instruction before 'pc' setting it loads an
+** integer constant, and no jump enters the code after that load.
+*/
+static int isintload (const Proto *f, const lu_byte *target, int pc,
+                      int reg) {
+  if (target[pc])
+    return 0;
+  while (--pc >= 0) {
+    Instruction i = f->code[pc];
+    if (maysetreg(f, i, reg)) {
+      if (GETARG_A(i) != reg)
+        return 0;
+      else if (GET_OPCODE(i) == OP_LOADI)
+        return 1;
+      else
+        return (GET_OPCODE(i) == OP_LOADK &&
+                ttisinteger(&f->k[GETARG_Bx(i)]));
+    }
+    else if (target[pc])
+      return 0;
+  }
+  return 0;
+}
+
+
+/*
+** Strength reduction: inside an integer loop, 'i % 2^n' where 'i' is
+** the control variable (which is an integer) becomes 'i & (2^n - 1)'.
+** The loop is an integer one when its initial value and its step are
+** integer constants.
+*/
+static void reducestrength (lua_State *L, Proto *f, const lu_byte *target) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    int ctrl = GETARG_A(i) + 2;  /* control variable */
+    int endloop, j;
+    if (GET_OPCODE(i) != OP_FORPREP ||
+        !isintload(f, target, pc, GETARG_A(i)) ||
+        !isintload(f, target, pc, ctrl))
+      continue;
+    endloop = pc + 1 + GETARG_Bx(i);  /* OP_FORLOOP */
+    for (j = pc + 1; j < endloop; j++) {  /* control variable is fixed? */
+      if (maysetreg(f, f->code[j], ctrl))
+        break;
+    }
+    if (j < endloop)
+      continue;
+    for (j = pc + 1; j < endloop; j++) {
+      Instruction *ij = &f->code[j];
+      if (GET_OPCODE(*ij) == OP_MODK && GETARG_B(*ij) == ctrl) {
+        const TValue *k = &f->k[GETARG_C(*ij)];
+        if (ttisinteger(k) && ivalue(k) > 0 &&
+            (ivalue(k) & (ivalue(k) - 1)) == 0) {  /* power of 2? */
+          int mask = intconstant(L, f, ivalue(k) - 1);
+          if (mask <= MAXARG_C) {
+            lua_assert(GET_OPCODE(*(ij + 1)) == OP_MMBINK);
+            SET_OPCODE(*ij, OP_BANDK);
+            SETARG_C(*ij, mask);
+            SETARG_B(*(ij + 1), mask);  /* keep metamethod call coherent */
+            SETARG_C(*(ij + 1), TM_BAND);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+/*
+** Jump threading: a jump to a return becomes that return, and a jump
+** to the next instruction is removed.
+*/
+static void threadjumps (Proto *f, lu_byte *removed) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_JMP && !isskipped(f, removed, pc)) {
+      int dest = pc + 1 + GETARG_sJ(i);
+      OpCode op = GET_OPCODE(f->code[dest]);
+      if (dest == pc + 1)
+        removed[pc] = 1;
+      else if (op == OP_RETURN0 || op == OP_RETURN1)
+        f->code[pc] = f->code[dest];
+    }
+  }
+}
+
+
+/*
+** Check whether instruction 'i' only loads a value into register A,
+** without side effects.
+*/
+static int ispureload (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADFALSE: case OP_LOADTRUE: case OP_GETUPVAL:
+      return 1;
+    case OP_LOADNIL:
+      return (GETARG_B(i) == 0);
+    default: return 0;
+  }
+}
+
+
+/*
+** Dead-store elimination: remove a load whose value is overwritten
+** by the following loads before being used. (As all instructions
+** involved are pure loads, no one else can see the register in
+** between.)
+*/
+static void removedeadstores (Proto *f, lu_byte *removed) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (!removed[pc] && ispureload(i) && !isskipped(f, removed, pc)) {
+      int reg = GETARG_A(i);
+      int next;
+      for (next = pc + 1; next < f->sizecode; next++) {
+        Instruction ni = f->code[next];
+        if (removed[next])
+          continue;
+        else if (!ispureload(ni) || readsreg(f, ni, reg))
+          break;
+        else if (setsreg(ni, reg)) {
+          removed[pc] = 1;
+          break;
+        }
+      }
+    }
+  }
+}
+
+
+/*
+** Check whether instruction 'i' computes a single value into register
+** A, using A for nothing else. (OP_NEWTABLE and OP_CLOSURE do not
+** qualify: they run the collector with the stack top at A + 1, so
+** moving them below live registers would let those be collected.)
+*/
+static int iscopysource (Instruction i) {
+  OpCode op = GET_OPCODE(i);
+  switch (op) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADKX: case OP_LOADFALSE: case OP_LOADTRUE: case OP_GETUPVAL:
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_GETVARG:
+      return 1;
+    default:  /* arithmetic operations */
+      return (OP_ADDI <= op && op <= OP_SHR);
+  }
+}
+
+
+/*
+** Check whether instruction 'i' always continues with the next one.
+*/
+static int isstraight (Instruction i) {
+  OpCode op = GET_OPCODE(i);
+  switch (op) {
+    case OP_JMP: case OP_LFALSESKIP: case OP_FORLOOP: case OP_FORPREP:
+    case OP_TFORPREP: case OP_TFORCALL: case OP_TFORLOOP: case OP_CLOSE:
+    case OP_TBC: case OP_RETURN: case OP_RETURN0: case OP_RETURN1:
+    case OP_TAILCALL:
+      return 0;
+    default:
+      return !testTMode(op);
+  }
+}
+
+
+/*
+** Check whether the value computed by instruction 'x' into register
+** 'temp' can go directly into register 'l' of the move at 'pc': the
+** instructions in between must run in sequence and cannot touch 'l'
+** or read 'temp' (except for the companion of 'x'). When there are
+** such instructions, 'l' cannot be captured by a closure, as they
+** could see its new value through the upvalue.
+*/
+static int cancopy (const Proto *f, const lu_byte *target,
+                    const lu_byte *removed, const lu_byte *captured,
+                    int x, int pc, int temp, int l) {
+  int j;
+  if (!iscopysource(f->code[x]) || GETARG_A(f->code[x]) != temp)
+    return 0;
+  for (j = x + 1; j < pc; j++) {
+    Instruction i = f->code[j];
+    if (removed[j])
+      continue;
+    if (target[j])
+      return 0;
+    switch (GET_OPCODE(i)) {
+      case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: case OP_EXTRAARG:
+        if (j == x + 1)
+          continue;  /* companion of 'x' */
+        break;
+      case OP_NEWTABLE: case OP_CLOSURE: case OP_CONCAT:
+        return 0;  /* collector could miss 'l' (see 'iscopysource') */
+      default: break;
+    }
+    if (captured[l] || !isstraight(i) || readsreg(f, i, temp) ||
+        readsreg(f, i, l) || maysetreg(f, i, l))
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Copy propagation: 'X T; ...; MOVE L T' becomes 'X L; ...' when 'T'
+** is a temporary not used after the move. The code generator already
+** computes single values into their variables, so this pattern comes
+** from multiple assignments, where the first values go through
+** temporaries.
+*/
+static void propagatecopies (Proto *f, const lu_byte *target,
+                             lu_byte *removed) {
+  lu_byte captured[MAX_FSTACK + 1];
+  int pc;
+  memset(captured, 0, sizeof(captured));
+  for (pc = 0; pc < f->sizecode; pc++) {  /* collect captured registers */
+    if (GET_OPCODE(f->code[pc]) == OP_CLOSURE) {
+      const Proto *p = f->p[GETARG_Bx(f->code[pc])];
+      int u;
+      for (u = 0; u < p->sizeupvalues; u++) {
+        if (p->upvalues[u].instack)
+          captured[p->upvalues[u].idx] = 1;
+      }
+    }
+  }
+  for (pc = 1; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    int x;  /* instruction that computes the copied value */
+    int temp, l;
+    int budget = MAXLIVESCAN;
+    if (GET_OPCODE(i) != OP_MOVE || removed[pc] || target[pc])
+      continue;
+    temp = GETARG_B(i);
+    l = GETARG_A(i);
+    /* find the last instruction before the move that may set 'temp' */
+    for (x = pc - 1; x >= 0 && pc - x <= MAXCOPYDIST; x--) {
+      if (!removed[x] && maysetreg(f, f->code[x], temp))
+        break;
+    }
+    if (x < 0 || pc - x > MAXCOPYDIST ||
+        !cancopy(f, target, removed, captured, x, pc, temp, l) ||
+        luaF_getlocalname(f, temp + 1, pc) != NULL ||  /* not temporary? */
+        !regdead(f, removed, pc + 1, temp, &budget))
+      continue;
+    SETARG_A(f->code[x], l);  /* compute value directly */
+    removed[pc] = 1;
+  }
+}
+
+
+/*
+** Check whether instruction 'i' may let a table in register 'reg'
+** escape, that is, copy it somewhere else or give it to some code.
+** Accesses to the fields of a private table do not let it escape, as
+** it cannot have a metatable: setting one needs a call with the table.
+*/
+static int letsescape (const Proto *f, Instruction i, int reg) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_GETI: case OP_GETFIELD: case OP_LEN: case OP_NOT: case OP_TEST:
+    case OP_CLOSE:  /* ('__close' gets only to-be-closed variables) */
+      return 0;
+    case OP_GETTABLE:  /* a key may go to an '__index' metamethod */
+      return (reg == GETARG_C(i));
+    case OP_SETTABLE:
+      if (reg == GETARG_B(i)) return 1;
+      /* FALLTHROUGH */
+    case OP_SETI: case OP_SETFIELD:  /* the value escapes, not the table */
+      return (!GETARG_k(i) && reg == GETARG_C(i));
+    case OP_SETLIST: {  /* values escape into the table in R[A] */
+      int b = GETARG_vB(i);
+      return (a < reg && (b == 0 || reg <= a + b));
+    }
+    default:
+      return readsreg(f, i, reg);
+  }
+}
+
+
+/*
+** Check whether a table created by the OP_NEWTABLE at 'pc' can escape
+** from its register 'reg'. The search follows all paths from that
+** instruction until some instruction overwrites 'reg', looking for
+** instructions that let the table escape. 'state' is a scratch array
+** with 'sizecode' elements: 1 marks instructions reached by some
+** path, 2 marks instructions already checked.
+*/
+static int tableescapes (const Proto *f, int pc, int reg, lu_byte *state) {
+  int changed = 1;
+  int n = f->sizecode;
+  int i;
+  for (i = 0; i < n; i++)
+    state[i] = 0;
+  state[pc + 2] = 1;  /* after the extra argument */
+  while (changed) {  /* repeat while backward jumps reach new code */
+    changed = 0;
+    for (pc = 0; pc < n; pc++) {
+      Instruction ins = f->code[pc];
+      OpCode op = GET_OPCODE(ins);
+      int next[2];  /* possible next instructions */
+      int nn = 0;
+      int k;
+      if (state[pc] != 1)
+        continue;  /* not reached or already checked */
+      state[pc] = 2;
+      if (letsescape(f, ins, reg))
+        return 1;
+      else if (setsreg(ins, reg))
+        continue;  /* table in 'reg' is gone */
+      switch (op) {
+        case OP_RETURN: case OP_RETURN0: case OP_RETURN1: case OP_TAILCALL:
+          break;
+        case OP_JMP:
+          next[nn++] = pc + 1 + GETARG_sJ(ins);
+          break;
+        case OP_LFALSESKIP:
+          next[nn++] = pc + 2;
+          break;
+        case OP_TFORPREP:
+          next[nn++] = pc + 1 + GETARG_Bx(ins);
+          break;
+        case OP_FORPREP:  /* may skip the loop */
+          next[nn++] = pc + 1;
+          next[nn++] = pc + 2 + GETARG_Bx(ins);
+          break;
+        case OP_FORLOOP: case OP_TFORLOOP:  /* may jump back */
+          next[nn++] = pc + 1;
+          next[nn++] = pc + 1 - GETARG_Bx(ins);
+          break;
+        default:
+          next[nn++] = pc + 1;
+          if (testTMode(op))  /* may skip the jump */
+            next[nn++] = pc + 2;
+          break;
+      }
+      for (k = 0; k < nn; k++) {
+        if (next[k] >= n)
+          return 1;  /* should not happen; be conservative */
+        else if (state[next[k]] == 0) {
+          state[next[k]] = 1;
+          if (next[k] < pc)
+            changed = 1;  /* must go back */
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Change to OP_NEWTABLEP the table constructors whose tables cannot
+** escape from their registers. The debug API can still get such a
+** table; 'lua_getlocal' handles that case. PF_PRIVTAB tells the VM
+** to erase the registers of each new activation of the function, so
+** that it never finds private tables left there by other frames.
+*/
+static void markprivatetables (Proto *f, lu_byte *state) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_NEWTABLE &&
+        !tableescapes(f, pc, GETARG_A(i), state)) {
+      SET_OPCODE(f->code[pc], OP_NEWTABLEP);
+      f->flag |= PF_PRIVTAB;
+    }
+  }
+}
+
+
+/*
+** Remove the marked instructions, correcting jumps and debug
+** information. 'newpc' and 'lines' are scratch arrays with (at least)
+** 'sizecode + 1' elements.
+*/
+static void compactcode (lua_State *L, Proto *f, const lu_byte *removed,
+                         int *newpc, int *lines) {
+  int n = f->sizecode;
+  int pc;
+  int npc = 0;
+  for (pc = 0; pc < n; pc++) {
+    newpc[pc] = npc;
+    if (!removed[pc])
+      npc++;
+  }
+  newpc[n] = npc;
+  if (npc == n)  /* nothing to remove? */
+    return;
+  if (f->lineinfo != NULL) {  /* save absolute line information */
+    AbsLineInfo *absinfo = luaM_newvector(L, npc, AbsLineInfo);
+    for (pc = 0; pc < n; pc++)
+      lines[pc] = luaG_getfuncline(f, pc);
+    luaM_freearray(L, f->abslineinfo, cast_sizet(f->sizeabslineinfo));
+    f->abslineinfo = absinfo;
+    f->sizeabslineinfo = npc;
+  }
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = f->code[pc];
+    int np = newpc[pc];
+    if (removed[pc])
+      continue;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP:
+        SETARG_sJ(i, newpc[pc + 1 + GETARG_sJ(i)] - (np + 1));
+        break;
+      case OP_FORPREP: case OP_TFORPREP:
+        SETARG_Bx(i, newpc[pc + 1 + GETARG_Bx(i)] - (np + 1));
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        SETARG_Bx(i, (np + 1) - newpc[pc + 1 - GETARG_Bx(i)]);
+        break;
+      default: break;
+    }
+    f->code[np] = i;  /* (np <= pc) */
+  }
+  if (f->lineinfo != NULL) {  /* rebuild line information */
+    int previousline = f->linedefined;
+    int iwthabs = 0;
+    int nabs = 0;
+    for (pc = 0; pc < n; pc++) {
+      if (!removed[pc]) {  /* same encoding used by 'savelineinfo' */
+        int linedif = lines[pc] - previousline;
+        if (abs(linedif) >= LIMLINEDIFF || iwthabs++ >= MAXIWTHABS) {
+          f->abslineinfo[nabs].pc = newpc[pc];
+          f->abslineinfo[nabs++].line = lines[pc];
+          linedif = ABSLINEINFO;
+          iwthabs = 1;
+        }
+        f->lineinfo[newpc[pc]] = cast(ls_byte, linedif);
+        previousline = lines[pc];
+      }
+    }
+    luaM_shrinkvector(L, f->abslineinfo, f->sizeabslineinfo, nabs,
+                         AbsLineInfo);
+    luaM_shrinkvector(L, f->lineinfo, f->sizelineinfo, npc, ls_byte);
+  }
+  for (pc = 0; pc < f->sizelocvars; pc++) {
+    f->locvars[pc].startpc = newpc[f->locvars[pc].startpc];
+    f->locvars[pc].endpc = newpc[f->locvars[pc].endpc];
+  }
+  luaM_shrinkvector(L, f->code, f->sizecode, npc, Instruction);
+  if (f->sizeicache > npc)
+    luaM_shrinkvector(L, f->icache, f->sizeicache, npc, unsigned int);
+}
+
+
+/*
+** Optimize the code of prototype 'f' and of its nested prototypes,
+** using 'buff' as scratch memory. This pass runs over finished
+** prototypes of text chunks when the load mode asks for it ('O').
+*/
+void luaK_optimize (lua_State *L, Proto *f, Mbuffer *buff) {
+  int n = f->sizecode;
+  size_t size = cast_sizet(2 * (n + 1)) * (sizeof(int) + sizeof(lu_byte));
+  int *newpc, *lines;
+  lu_byte *removed, *target;
+  int i;
+  if (luaZ_sizebuffer(buff) < size)
+    luaZ_resizebuffer(L, buff, size);
+  newpc = cast(int *, luaZ_buffer(buff));
+  lines = newpc + (n + 1);
+  removed = cast(lu_byte *, lines + (n + 1));
+  target = removed + (n + 1);
+  for (i = 0; i <= n; i++)
+    removed[i] = target[i] = 0;
+  marktargets(f, target);
+  reducestrength(L, f, target);
+  threadjumps(f, removed);
+  removedeadstores(f, removed);
+  propagatecopies(f, target, removed);
+  compactcode(L, f, removed, newpc, lines);
+  markprivatetables(f, removed);  /* ('removed' is free now) */
+  for (i = 1; i < f->sizecode; i++) {  /* check final code */
+    lua_assert(luaP_isOT(f->code[i - 1]) == luaP_isIT(f->code[i]));
+    lua_assert(!testTMode(GET_OPCODE(f->code[i - 1])) ||
+               GET_OPCODE(f->code[i]) == OP_JMP);
+  }
+  for (i = 0; i < f->sizep; i++)
+    luaK_optimize(L, f->p[i], buff);
+}
+
+/* }====================================================== */
@@ -99,6 +99,11 @@ LUAI_FUNC void luaK_settablesize (FuncState *fs, int pc,
                                   int ra, int asize, int hsize);
 LUAI_FUNC void luaK_setlist (FuncState *fs, int base, int nelems, int tostore);
 LUAI_FUNC void luaK_finish (FuncState *fs);
+LUAI_FUNC int luaK_inline (FuncState *fs, const Proto *p, int base,
+                           int nparams, int line);
+LUAI_FUNC void luaK_loadfunc (FuncState *fs, int base, int freg,
+                              int nparams);
+LUAI_FUNC void luaK_optimize (lua_State *L, Proto *f, Mbuffer *buff);
 LUAI_FUNC l_noret luaK_semerror (LexState *ls, const char *fmt, ...);
 
 
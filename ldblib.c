@@ -10,6 +10,8 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -420,6 +422,330 @@ static int db_gethook (lua_State *L) {
 }
 
 
+/*
+** Set the budget of a thread: when it runs out, the thread yields
+** (see 'lua_setbudget').
+*/
+static int db_setbudget (lua_State *L) {
+  int arg;
+  lua_State *L1 = getthread(L, &arg);
+  lua_Integer budget = luaL_optinteger(L, arg + 1, 0);
+  luaL_argcheck(L, budget <= INT_MAX, arg + 1, "budget too large");
+  lua_setbudget(L1, (int)budget, NULL);
+  return 0;
+}
+
+
+/*
+** {======================================================
+** Sampling profiler
+** A timer (ITIMER_PROF) sends SIGPROF periodically; the signal handler
+** only calls 'lua_sample', so that the running thread calls 'profhook'
+** before its next instruction. 'profhook' records the stack of that
+** thread, in the collapsed format used by flame-graph tools (frames
+** from the outermost to the innermost, separated by ';'), into the
+** next entry of a preallocated ring buffer. The buffer is a userdata
+** kept at registry[PROFKEY]. Only one state can be profiled at a time.
+** Without POSIX there is no timer, and "start" reports that the
+** profiler is not available.
+** =======================================================
+*/
+
+static const char *const PROFKEY = "_PROFKEY";
+
+/* size of each entry in the ring buffer */
+#if !defined(LUA_PROFENTRY)
+#define LUA_PROFENTRY	512
+#endif
+
+
+typedef struct Profile {
+  int size;  /* number of entries in the ring buffer */
+  int next;  /* next entry to be written */
+  lua_Integer count;  /* number of samples taken */
+  char buff[1];  /* entries */
+} Profile;
+
+
+#define profentry(p,i)	((p)->buff + cast_sizet(i) * LUA_PROFENTRY)
+
+
+/* profile being collected (NULL if profiler is stopped) */
+static Profile *volatile profiling = NULL;
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+
+/*
+** Record the stack of 'L' in the next entry of the ring buffer. The
+** entry is built backwards, from the innermost frame; frames that do
+** not fit in the entry are dropped from the outermost end.
+*/
+static void profhook (lua_State *L, lua_Debug *ar) {
+  Profile *p = profiling;
+  (void)ar;  /* not used */
+  if (p != NULL) {
+    char *e = profentry(p, p->next);
+    char *end = e + LUA_PROFENTRY - 1;
+    char *pos = end;
+    lua_Debug d;
+    int level;
+    *end = '\0';
+    for (level = 0; lua_getstack(L, level, &d); level++) {
+      char frame[LUA_IDSIZE + 96];
+      int n;
+      lua_getinfo(L, "Snl", &d);
+      if (d.name != NULL)  /* is there a name? */
+        n = l_sprintf(frame, sizeof(frame), "%.40s", d.name);
+      else if (*d.what == 'm')  /* main? */
+        n = l_sprintf(frame, sizeof(frame), "%s", "main chunk");
+      else if (*d.what != 'C')  /* Lua function? */
+        n = l_sprintf(frame, sizeof(frame), "function:%d", d.linedefined);
+      else
+        n = l_sprintf(frame, sizeof(frame), "%s", "?");
+      n += l_sprintf(frame + n, sizeof(frame) - cast_sizet(n), "@%s",
+                                d.short_src);
+      if (d.currentline >= 0)
+        n += l_sprintf(frame + n, sizeof(frame) - cast_sizet(n), ":%d",
+                                  d.currentline);
+      if (n < 0 || n >= (int)sizeof(frame) || n + 1 > pos - e)
+        break;  /* no more space */
+      if (pos != end)
+        *--pos = ';';
+      pos -= n;
+      memcpy(pos, frame, cast_sizet(n));
+    }
+    memmove(e, pos, cast_sizet(end - pos) + 1);
+    p->next = (p->next + 1) % p->size;
+    p->count++;
+  }
+}
+
+
+static lua_State *profstate = NULL;  /* state being profiled */
+
+
+static void profsignal (int i) {
+  (void)i;  /* not used */
+  if (profiling != NULL)
+    lua_sample(profstate, profhook);
+}
+
+
+/*
+** Set the profiling timer to 'interval' seconds (0 stops it).
+*/
+static int settimer (lua_Number interval) {
+  struct itimerval t;
+  long us = (long)(interval * 1e6);
+  if (interval > 0 && us == 0) us = 1;
+  t.it_interval.tv_sec = t.it_value.tv_sec = us / 1000000;
+  t.it_interval.tv_usec = t.it_value.tv_usec = us % 1000000;
+  return setitimer(ITIMER_PROF, &t, NULL);
+}
+
+
+/*
+** Start the timer; returns NULL or an error message.
+*/
+static const char *startprofiler (lua_State *L, lua_Number interval) {
+  struct sigaction sa;
+  sa.sa_handler = profsignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  profstate = lua_tothread(L, -1);  /* main thread lives as long as state */
+  lua_pop(L, 1);
+  if (sigaction(SIGPROF, &sa, NULL) != 0 || settimer(interval) != 0)
+    return strerror(errno);
+  return NULL;
+}
+
+
+/*
+** Stop the timer. (The handler stays installed, so that a signal still
+** pending does not kill the process; it does nothing after this.)
+*/
+#define stopprofiler()		((void)settimer(0))
+
+#else				/* }{ */
+
+#define startprofiler(L,i)	((void)(L), (void)(i), "profiler not available")
+#define stopprofiler()		((void)0)
+
+#endif				/* } */
+
+
+static void stopprofile (Profile *p) {
+  if (p != NULL && profiling == p) {
+    stopprofiler();
+    profiling = NULL;
+  }
+}
+
+
+static int profgc (lua_State *L) {
+  stopprofile((Profile *)lua_touserdata(L, 1));
+  return 0;
+}
+
+
+static Profile *getprofile (lua_State *L) {
+  Profile *p;
+  lua_getfield(L, LUA_REGISTRYINDEX, PROFKEY);
+  p = (Profile *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return p;
+}
+
+
+static int profstart (lua_State *L) {
+  lua_Number interval = luaL_optnumber(L, 2, 0.001);
+  lua_Integer size = luaL_optinteger(L, 3, 1000);
+  Profile *p;
+  const char *msg;
+  luaL_argcheck(L, interval > 0, 2, "interval must be positive");
+  luaL_argcheck(L, 0 < size && size <= INT_MAX / LUA_PROFENTRY, 3,
+                   "invalid size");
+  stopprofile(profiling);  /* stop current profiler, if any */
+  p = (Profile *)lua_newuserdatauv(L, offsetof(Profile, buff) +
+                        cast_sizet(size) * LUA_PROFENTRY, 0);
+  p->size = (int)size;
+  p->next = 0;
+  p->count = 0;
+  memset(p->buff, 0, cast_sizet(size) * LUA_PROFENTRY);
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, profgc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, PROFKEY);
+  profiling = p;
+  msg = startprofiler(L, interval);
+  if (msg != NULL) {  /* error? */
+    profiling = NULL;
+    luaL_pushfail(L);
+    lua_pushstring(L, msg);
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int profdump (lua_State *L) {
+  Profile *p = getprofile(L);
+  luaL_Buffer b;
+  int i, nlines = 0;
+  if (p == NULL)
+    return luaL_error(L, "no profile was collected");
+  lua_newtable(L);  /* counts for each different stack */
+  for (i = 0; i < p->size; i++) {
+    const char *e = profentry(p, i);
+    if (*e != '\0') {
+      lua_Integer n;
+      lua_pushstring(L, e);
+      lua_pushvalue(L, -1);
+      n = (lua_rawget(L, -3) == LUA_TNUMBER) ? lua_tointeger(L, -1) : 0;
+      lua_pop(L, 1);
+      lua_pushinteger(L, n + 1);
+      lua_rawset(L, -3);
+    }
+  }
+  lua_newtable(L);  /* lines of the result */
+  lua_pushnil(L);
+  while (lua_next(L, -3)) {  /* for each stack in the table */
+    lua_pushfstring(L, "%s %I\n", lua_tostring(L, -2),
+                                   (LUAI_UACINT)lua_tointeger(L, -1));
+    lua_rawseti(L, -4, ++nlines);
+    lua_pop(L, 1);  /* remove count */
+  }
+  luaL_buffinit(L, &b);
+  for (i = 1; i <= nlines; i++) {
+    lua_rawgeti(L, -2, i);
+    luaL_addvalue(&b);
+  }
+  luaL_pushresult(&b);
+  lua_pushinteger(L, p->count);
+  return 2;
+}
+
+
+/*
+** debug.profile("start" [, interval [, size]]): start profiling the
+** state, taking a sample every 'interval' seconds of CPU time and
+** keeping the last 'size' samples.
+** debug.profile("stop"): stop profiling.
+** debug.profile("dump"): return the samples in the collapsed format
+** (one line for each different stack, followed by its number of
+** occurrences), plus the total number of samples taken.
+*/
+static int db_profile (lua_State *L) {
+  static const char *const opts[] = {"start", "stop", "dump", NULL};
+  switch (luaL_checkoption(L, 1, NULL, opts)) {
+    case 0: return profstart(L);
+    case 1: stopprofile(getprofile(L)); return 0;
+    default: return profdump(L);
+  }
+}
+
+/* }====================================================== */
+
+
+/*
+** Opcode statistics: returns a table with the number of executions of
+** each opcode, a table with the number of executions of each pair of
+** consecutive opcodes (keyed by "PREV NEXT"), and a table with the
+** clock ticks spent in each opcode. Only non-zero entries are present.
+** Option "reset" clears all statistics. Returns fail if the statistics
+** are not available.
+*/
+static int db_opstats (lua_State *L) {
+  lua_Unsigned count, cycles;
+  int op, prev, nops;
+  if (lua_getopstat(L, 0, -1, &count, &cycles) == NULL) {
+    luaL_pushfail(L);  /* statistics not available */
+    return 1;
+  }
+  if (!lua_isnoneornil(L, 1)) {
+    static const char *const opts[] = {"reset", NULL};
+    luaL_checkoption(L, 1, NULL, opts);
+    lua_getopstat(L, -1, -1, NULL, NULL);
+    return 0;
+  }
+  for (nops = 0; lua_getopstat(L, nops, -1, &count, &cycles); nops++)
+    ;  /* count opcodes */
+  lua_createtable(L, 0, nops);  /* counts */
+  lua_newtable(L);  /* pairs */
+  lua_createtable(L, 0, nops);  /* cycles */
+  for (op = 0; op < nops; op++) {
+    const char *name = lua_getopstat(L, op, -1, &count, &cycles);
+    if (count > 0) {
+      lua_pushinteger(L, (lua_Integer)count);
+      lua_setfield(L, -4, name);
+    }
+    if (cycles > 0) {
+      lua_pushinteger(L, (lua_Integer)cycles);
+      lua_setfield(L, -2, name);
+    }
+    for (prev = 0; prev < nops; prev++) {
+      lua_getopstat(L, op, prev, &count, &cycles);
+      if (count > 0) {
+        lua_Unsigned dummy;
+        const char *pname = lua_getopstat(L, prev, -1, &dummy, &dummy);
+        lua_pushfstring(L, "%s %s", pname, name);
+        lua_pushinteger(L, (lua_Integer)count);
+        lua_settable(L, -4);
+      }
+    }
+  }
+  return 3;
+}
+
+
 static int db_debug (lua_State *L) {
   for (;;) {
     char buffer[250];
@@ -458,10 +784,13 @@ static const luaL_Reg dblib[] = {
   {"getregistry", db_getregistry},
   {"getmetatable", db_getmetatable},
   {"getupvalue", db_getupvalue},
+  {"profile", db_profile},
+  {"opstats", db_opstats},
   {"upvaluejoin", db_upvaluejoin},
   {"upvalueid", db_upvalueid},
   {"setuservalue", db_setuservalue},
   {"sethook", db_sethook},
+  {"setbudget", db_setbudget},
   {"setlocal", db_setlocal},
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
@@ -23,6 +23,7 @@
 #include "lfunc.h"
 #include "lobject.h"
 #include "lopcodes.h"
+#include "lopnames.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
@@ -78,27 +79,76 @@ static int getbaseline (const Proto *f, int pc, int *basepc) {
 
 
 /*
-** Get the line corresponding to instruction 'pc' in function 'f';
-** first gets a base line and from there does the increments until
-** the desired instruction.
+** Compute the line corresponding to instruction 'pc' in function 'f'
+** from its compact line information: first gets a base line and from
+** there does the increments until the desired instruction.
+*/
+static int computeline (const Proto *f, int pc) {
+  int basepc;
+  int baseline = getbaseline(f, pc, &basepc);
+  while (basepc++ < pc) {  /* walk until given instruction */
+    lua_assert(f->lineinfo[basepc] != ABSLINEINFO);
+    baseline += f->lineinfo[basepc];  /* correct line */
+  }
+  return baseline;
+}
+
+
+/*
+** Get the line corresponding to instruction 'pc' in function 'f',
+** using its direct map of lines, if there is one.
 */
 int luaG_getfuncline (const Proto *f, int pc) {
   if (f->lineinfo == NULL)  /* no debug information? */
     return -1;
-  else {
-    int basepc;
-    int baseline = getbaseline(f, pc, &basepc);
-    while (basepc++ < pc) {  /* walk until given instruction */
-      lua_assert(f->lineinfo[basepc] != ABSLINEINFO);
-      baseline += f->lineinfo[basepc];  /* correct line */
+  else if (f->lineidx != NULL) {  /* has a direct map? */
+    lua_assert(f->lineidx[pc] == computeline(f, pc));
+    return f->lineidx[pc];
+  }
+  else
+    return computeline(f, pc);
+}
+
+
+/*
+** Build the direct map from instructions to lines of function 'f', so
+** that further calls to 'luaG_getfuncline' are O(1). The map is built
+** only for running functions whose lines are being queried (errors,
+** 'getinfo', line hooks), as the code of a function cannot change
+** after it starts running. A failure to allocate the map is not an
+** error; lines are then computed from the compact line information.
+*/
+static void buildlineidx (lua_State *L, Proto *f) {
+  int n = f->sizelineinfo;
+  int *idx = luaM_reallocvector(L, NULL, 0, n, int);
+  if (idx != NULL) {
+    int pc;
+    int line = f->linedefined;
+    for (pc = 0; pc < n; pc++) {
+      if (f->lineinfo[pc] != ABSLINEINFO)
+        line += f->lineinfo[pc];
+      else
+        line = computeline(f, pc);
+      idx[pc] = line;
     }
-    return baseline;
+    f->lineidx = idx;
   }
 }
 
 
-static int getcurrentline (CallInfo *ci) {
-  return luaG_getfuncline(ci_func(ci)->p, currentpc(ci));
+/*
+** Get the line corresponding to instruction 'pc' in function 'f',
+** which is running.
+*/
+static int getrunningline (lua_State *L, Proto *f, int pc) {
+  if (f->lineidx == NULL && f->lineinfo != NULL)
+    buildlineidx(L, f);
+  return luaG_getfuncline(f, pc);
+}
+
+
+static int getcurrentline (lua_State *L, CallInfo *ci) {
+  return getrunningline(L, ci_func(ci)->p, currentpc(ci));
 }
 
 
@@ -150,7 +200,7 @@ LUA_API lua_Hook lua_gethook (lua_State *L) {
 
 
 LUA_API int lua_gethookmask (lua_State *L) {
-  return L->hookmask;
+  return L->hookmask & ~(MASKSAMPLE | MASKBUDGET);
 }
 
 
@@ -159,6 +209,80 @@ LUA_API int lua_gethookcount (lua_State *L) {
 }
 
 
+/*
+** Ask the thread currently running Lua code in the state of 'L' to call
+** 'f' at its next safe point, that is, before its next Lua instruction.
+** ('f' is called as a hook, with event LUA_HOOKSAMPLE.) Like
+** 'lua_sethook', this function can be called during a signal; it is
+** intended for sampling profilers.
+*/
+LUA_API void lua_sample (lua_State *L, lua_Hook f) {
+  global_State *g = G(L);
+  lua_State *L1 = g->running;
+  g->sampler = f;
+  L1->hookmask |= MASKSAMPLE;
+  settraps(L1->ci);  /* to stop inside 'luaV_execute' */
+}
+
+
+/*
+** Set an execution budget for thread 'L': it is charged one unit at
+** each call and at each backward jump (that is, at each iteration of
+** a loop) in Lua code. When the budget runs out, the thread calls 'f'
+** (as a hook, with event LUA_HOOKBUDGET) or, if 'f' is NULL, yields,
+** and then gets a new budget of the same size. A non-positive 'budget'
+** turns off the budget. Unlike a count hook, a budget does not make
+** each instruction stop inside 'luaG_traceexec'.
+*/
+LUA_API void lua_setbudget (lua_State *L, int budget, lua_Hook f) {
+  if (budget <= 0) {  /* turn off budget? */
+    budget = 0;
+    f = NULL;
+  }
+  L->budgethook = f;
+  L->basebudget = budget;
+  resetbudget(L);
+  L->hookmask &= ~MASKBUDGET;  /* discard a pending exhaustion */
+}
+
+
+/*
+** Get the execution statistics of opcode 'op': its number of executions
+** and the clock ticks spent in it or, if 'prev' is a valid opcode, the
+** number of times 'op' was executed right after 'prev'. Returns the
+** opcode name, or NULL if 'op' is not a valid opcode or the statistics
+** are not available (Lua was not built with LUAI_OPSTATS). A negative
+** 'op' resets all statistics.
+*/
+LUA_API const char *lua_getopstat (lua_State *L, int op, int prev,
+                                   lua_Unsigned *count,
+                                   lua_Unsigned *cycles) {
+#if defined(LUAI_OPSTATS)
+  OpStats *s = &G(L)->opstats;
+  if (op < 0) {  /* reset? */
+    memset(s->count, 0, sizeof(s->count));
+    memset(s->pair, 0, sizeof(s->pair));
+    memset(s->cycles, 0, sizeof(s->cycles));
+    return NULL;
+  }
+  else if (op >= NUM_OPCODES)
+    return NULL;
+  else if (0 <= prev && prev < NUM_OPCODES) {
+    *count = s->pair[prev][op];
+    *cycles = 0;
+  }
+  else {
+    *count = s->count[op];
+    *cycles = s->cycles[op];
+  }
+  return opnames[op];
+#else
+  UNUSED(L); UNUSED(op); UNUSED(prev); UNUSED(count); UNUSED(cycles);
+  return NULL;
+#endif
+}
+
+
 LUA_API int lua_getstack (lua_State *L, int level, lua_Debug *ar) {
   int status;
   CallInfo *ci;
@@ -232,6 +356,8 @@ LUA_API const char *lua_getlocal (lua_State *L, const lua_Debug *ar, int n) {
     StkId pos = NULL;  /* to avoid warnings */
     name = luaG_findlocal(L, ar->i_ci, n, &pos);
     if (name) {
+      if (ttistable(s2v(pos)))  /* table escaping from its register? */
+        setnoprivate(hvalue(s2v(pos)));  /* it cannot be reused anymore */
       setobjs2s(L, L->top.p, pos);
       api_incr_top(L);
     }
@@ -338,7 +464,7 @@ static int auxgetinfo (lua_State *L, const char *what, lua_Debug *ar,
         break;
       }
       case 'l': {
-        ar->currentline = (ci && isLua(ci)) ? getcurrentline(ci) : -1;
+        ar->currentline = (ci && isLua(ci)) ? getcurrentline(L, ci) : -1;
         break;
       }
       case 'u': {
@@ -511,7 +637,7 @@ static const char *basicgetobjname (const Proto *p, int *ppc, int reg,
   /* else try symbolic execution */
   *ppc = pc = findsetreg(p, pc, reg);
   if (pc != -1) {  /* could find instruction? */
-    Instruction i = p->code[pc];
+    Instruction i = luaP_unquicken(p->code[pc]);
     OpCode op = GET_OPCODE(i);
     switch (op) {
       case OP_MOVE: {
@@ -572,7 +698,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
   if (kind != NULL)
     return kind;
   else if (lastpc != -1) {  /* could find instruction? */
-    Instruction i = p->code[lastpc];
+    Instruction i = luaP_unquicken(p->code[lastpc]);
     OpCode op = GET_OPCODE(i);
     switch (op) {
       case OP_GETTABUP: {
@@ -615,7 +741,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
 static const char *funcnamefromcode (lua_State *L, const Proto *p,
                                      int pc, const char **name) {
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
-  Instruction i = p->code[pc];  /* calling instruction */
+  Instruction i = luaP_unquicken(p->code[pc]);  /* calling instruction */
   switch (GET_OPCODE(i)) {
     case OP_CALL:
     case OP_TAILCALL:
@@ -862,7 +988,7 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
   pushvfstring(L, argp, fmt, msg);
   if (isLua(ci)) {  /* Lua function? */
     /* add source:line information */
-    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(ci));
+    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(L, ci));
     setobjs2s(L, L->top.p - 2, L->top.p - 1);  /* remove 'msg' */
     L->top.p--;
   }
@@ -881,6 +1007,8 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
 static int changedline (const Proto *p, int oldpc, int newpc) {
   if (p->lineinfo == NULL)  /* no debug information? */
     return 0;
+  if (p->lineidx != NULL)  /* has a direct map? */
+    return (p->lineidx[oldpc] != p->lineidx[newpc]);
   if (newpc - oldpc < MAXIWTHABS / 2) {  /* not too far apart? */
     int delta = 0;  /* line difference */
     int pc = oldpc;
@@ -938,7 +1066,7 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   lu_byte mask = cast_byte(L->hookmask);
   const Proto *p = ci_func(ci)->p;
   int counthook;
-  if (!(mask & (LUA_MASKLINE | LUA_MASKCOUNT))) {  /* no hooks? */
+  if (!(mask & (LUA_MASKLINE | LUA_MASKCOUNT | MASKSAMPLE | MASKBUDGET))) {
     ci->u.l.trap = 0;  /* don't need to stop again */
     return 0;  /* turn off 'trap' */
   }
@@ -947,7 +1075,7 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   counthook = (mask & LUA_MASKCOUNT) && (--L->hookcount == 0);
   if (counthook)
     resethookcount(L);  /* reset count */
-  else if (!(mask & LUA_MASKLINE))
+  else if (!(mask & (LUA_MASKLINE | MASKSAMPLE | MASKBUDGET)))
     return 1;  /* no line hook and count != 0; nothing to be done now */
   if (ci->callstatus & CIST_HOOKYIELD) {  /* hook yielded last time? */
     ci->callstatus &= ~CIST_HOOKYIELD;  /* erase mark */
@@ -955,6 +1083,10 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   }
   if (!luaP_isIT(*(ci->u.l.savedpc - 1)))  /* top not being used? */
     L->top.p = ci->top.p;  /* correct top */
+  if (mask & MASKSAMPLE) {  /* sample requested? */
+    L->hookmask &= ~MASKSAMPLE;  /* only one sample per request */
+    luaD_hook(L, LUA_HOOKSAMPLE, -1, 0, 0);  /* call sampler */
+  }
   if (counthook)
     luaD_hook(L, LUA_HOOKCOUNT, -1, 0, 0);  /* call count hook */
   if (mask & LUA_MASKLINE) {
@@ -963,11 +1095,21 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
     int npci = pcRel(pc, p);
     if (npci <= oldpc ||  /* call hook when jump back (loop), */
         changedline(p, oldpc, npci)) {  /* or when enter new line */
-      int newline = luaG_getfuncline(p, npci);
+      int newline = getrunningline(L, ci_func(ci)->p, npci);
       luaD_hook(L, LUA_HOOKLINE, newline, 0, 0);  /* call line hook */
     }
     L->oldpc = npci;  /* 'pc' of last call to line hook */
   }
+  if ((mask & MASKBUDGET) && L->status != LUA_YIELD) {  /* out of budget? */
+    L->hookmask &= ~MASKBUDGET;
+    resetbudget(L);  /* give thread a new budget */
+    if (L->budgethook != NULL)
+      luaD_hook(L, LUA_HOOKBUDGET, -1, 0, 0);  /* call budget hook */
+    else if (yieldable(L)) {  /* yield as if from a hook */
+      L->status = LUA_YIELD;
+      ci->u2.nyield = 0;
+    }
+  }
   if (L->status == LUA_YIELD) {  /* did hook yield? */
     if (counthook)
       L->hookcount = 1;  /* undo decrement to zero */
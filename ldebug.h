@@ -20,6 +20,14 @@
 
 #define resethookcount(L)	(L->hookcount = L->basehookcount)
 
+/* bit in 'hookmask' signaling a pending sample (see 'lua_sample') */
+#define MASKSAMPLE	(1 << LUA_HOOKSAMPLE)
+
+#define resetbudget(L)	(L->budget = L->basebudget)
+
+/* bit in 'hookmask' signaling that the budget ran out */
+#define MASKBUDGET	(1 << LUA_HOOKBUDGET)
+
 /*
 ** mark for entries in 'lineinfo' array that has absolute information in
 ** 'abslineinfo' array
@@ -17,6 +17,7 @@
 #include "lua.h"
 
 #include "lapi.h"
+#include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
@@ -322,6 +323,122 @@ static void correctstack (lua_State *L, StkId oldstack) {
 #endif
 
 
+/*
+** {==================================================================
+** Reserved stacks
+** When LUAI_MMAPSTACK is defined (it needs POSIX 'mmap'), a stack that
+** grows beyond LUAI_MMAPSTACKMIN slots is moved (once) into a region
+** of virtual memory large enough for the largest possible stack. The
+** system commits pages of that region only when they are touched, so
+** further changes in the size of the stack never move it, and there is
+** no need to correct pointers into it. When the stack shrinks, the
+** pages not in use are returned to the system. The memory in use by
+** the stack is accounted as if it was allocated with 'frealloc'.
+** The system commits those pages without 'frealloc' knowing, so, to
+** keep allocation failures working for stacks, each growth asks
+** 'frealloc' first for a block of the size of the growth (freed at
+** once); if that fails, the growth fails like a failed reallocation.
+** Still, an allocator that limits the total memory in use does not
+** count the stack after that check.
+** ===================================================================
+*/
+#if defined(LUAI_MMAPSTACK)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(LUAI_MMAPSTACKMIN)
+#define LUAI_MMAPSTACKMIN	8192
+#endif
+
+/* size (in bytes) of the region reserved for a stack */
+#define RESERVEDSIZE  \
+	(cast_sizet(ERRORSTACKSIZE + EXTRA_STACK) * sizeof(StackValue))
+
+/* size (in bytes) of a stack with 'n' slots */
+#define stackbytes(n)	(cast_sizet((n) + EXTRA_STACK) * sizeof(StackValue))
+
+
+/*
+** Check whether 'frealloc' can give 'n' more bytes, allocating and
+** freeing a block with that size.
+*/
+static int cangrow (lua_State *L, size_t n) {
+  void *b = luaM_realloc_(L, NULL, 0, n);
+  if (b == NULL)
+    return 0;
+  luaM_free_(L, b, n);
+  return 1;
+}
+
+
+/*
+** Try to move a stack with 'oldsize' slots into a new reserved region.
+** Returns NULL if the region cannot be reserved or if 'frealloc' could
+** not give a stack with 'newsize' slots.
+*/
+static StkId reservestack (lua_State *L, StkId oldstack, int oldsize,
+                                         int newsize) {
+  void *r;
+  if (!cangrow(L, stackbytes(newsize)))
+    return NULL;
+  r = mmap(NULL, RESERVEDSIZE, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (r == MAP_FAILED)
+    return NULL;
+  memcpy(r, oldstack, stackbytes(oldsize));
+  luaM_freearray(L, oldstack, cast_sizet(oldsize + EXTRA_STACK));
+  G(L)->GCdebt -= cast(l_mem, stackbytes(newsize));  /* account new size */
+  L->mmstack = 1;
+  return cast(StkId, r);
+}
+
+
+/*
+** Change the size of a reserved stack, giving back to the system the
+** pages that are not in use anymore. (Stack stays in the same place.)
+** Returns 0 if 'frealloc' refuses the growth.
+*/
+static int resizereserved (lua_State *L, int oldsize, int newsize) {
+  if (newsize > oldsize) {
+    if (!cangrow(L, stackbytes(newsize) - stackbytes(oldsize)))
+      return 0;
+  }
+  else if (newsize < oldsize) {
+    size_t pgsize = cast_sizet(sysconf(_SC_PAGESIZE));
+    size_t start = (stackbytes(newsize) + pgsize - 1) & ~(pgsize - 1);
+    size_t end = stackbytes(oldsize);
+    if (start < end)
+      madvise(cast_charp(L->stack.p) + start, end - start, MADV_DONTNEED);
+  }
+  G(L)->GCdebt -= cast(l_mem, stackbytes(newsize))
+                - cast(l_mem, stackbytes(oldsize));
+  return 1;
+}
+
+
+void luaD_freestack (lua_State *L) {
+  int size = stacksize(L);
+  if (L->mmstack) {
+    munmap(L->stack.p, RESERVEDSIZE);
+    G(L)->GCdebt += cast(l_mem, stackbytes(size));
+  }
+  else
+    luaM_freearray(L, L->stack.p, cast_sizet(size + EXTRA_STACK));
+}
+
+#else
+
+#define resizereserved(L,os,ns)		(lua_assert(0), 0)
+
+void luaD_freestack (lua_State *L) {
+  luaM_freearray(L, L->stack.p, cast_sizet(stacksize(L) + EXTRA_STACK));
+}
+
+#endif
+/* }================================================================== */
+
+
 /*
 ** Reallocate the stack to a new size, correcting all pointers into it.
 ** In case of allocation error, raise an error or return false according
@@ -334,10 +451,31 @@ int luaD_reallocstack (lua_State *L, int newsize, int raiseerror) {
   StkId oldstack = L->stack.p;
   lu_byte oldgcstop = G(L)->gcstopem;
   lua_assert(newsize <= MAXSTACK || newsize == ERRORSTACKSIZE);
+  if (L->mmstack) {  /* stack in a reserved region? */
+    int ok;
+    G(L)->gcstopem = 1;  /* stop emergency collection */
+    ok = resizereserved(L, oldsize, newsize);  /* it does not move */
+    G(L)->gcstopem = oldgcstop;  /* restore emergency collection */
+    if (l_unlikely(!ok)) {  /* growth refused? */
+      if (raiseerror)
+        luaM_error(L);
+      else return 0;  /* do not raise an error */
+    }
+    L->stack_last.p = L->stack.p + newsize;
+    for (i = oldsize + EXTRA_STACK; i < newsize + EXTRA_STACK; i++)
+      setnilvalue(s2v(oldstack + i)); /* erase new segment */
+    return 1;
+  }
   relstack(L);  /* change pointers to offsets */
   G(L)->gcstopem = 1;  /* stop emergency collection */
-  newstack = luaM_reallocvector(L, oldstack, oldsize + EXTRA_STACK,
-                                   newsize + EXTRA_STACK, StackValue);
+  newstack = NULL;
+#if defined(LUAI_MMAPSTACK)
+  if (newsize >= LUAI_MMAPSTACKMIN)  /* large stack? */
+    newstack = reservestack(L, oldstack, oldsize, newsize);  /* try it */
+#endif
+  if (newstack == NULL)
+    newstack = luaM_reallocvector(L, oldstack, oldsize + EXTRA_STACK,
+                                     newsize + EXTRA_STACK, StackValue);
   G(L)->gcstopem = oldgcstop;  /* restore emergency collection */
   if (l_unlikely(newstack == NULL)) {  /* reallocation failed? */
     correctstack(L, oldstack);  /* change offsets back to pointers */
@@ -446,7 +584,9 @@ void luaD_inctop (lua_State *L) {
 */
 void luaD_hook (lua_State *L, int event, int line,
                               int ftransfer, int ntransfer) {
-  lua_Hook hook = L->hook;
+  lua_Hook hook = (event == LUA_HOOKSAMPLE) ? G(L)->sampler
+                : (event == LUA_HOOKBUDGET) ? L->budgethook
+                : L->hook;
   if (hook && L->allowhook) {  /* make sure there is a hook */
     CallInfo *ci = L->ci;
     ptrdiff_t top = savestack(L, L->top.p);  /* preserve original 'top' */
@@ -624,26 +764,6 @@ void luaD_poscall (lua_State *L, CallInfo *ci, int nres) {
 
 
 
-#define next_ci(L)  (L->ci->next ? L->ci->next : luaE_extendCI(L, 1))
-
-
-/*
-** Allocate and initialize CallInfo structure. At this point, the
-** only valid fields in the call status are number of results,
-** CIST_C (if it's a C function), and number of extra arguments.
-** (All these bit-fields fit in 16-bit values.)
-*/
-l_sinline CallInfo *prepCallInfo (lua_State *L, StkId func, unsigned status,
-                                                StkId top) {
-  CallInfo *ci = L->ci = next_ci(L);  /* new frame */
-  ci->func.p = func;
-  lua_assert((status & ~(CIST_NRESULTS | CIST_C | MAX_CCMT)) == 0);
-  ci->callstatus = status;
-  ci->top.p = top;
-  return ci;
-}
-
-
 /*
 ** precall for C functions
 */
@@ -652,8 +772,8 @@ l_sinline int precallC (lua_State *L, StkId func, unsigned status,
   int n;  /* number of returns */
   CallInfo *ci;
   checkstackp(L, LUA_MINSTACK, func);  /* ensure minimum stack size */
-  L->ci = ci = prepCallInfo(L, func, status | CIST_C,
-                               L->top.p + LUA_MINSTACK);
+  ci = luaD_prepCallInfo(L, func, status | CIST_C,
+                            L->top.p + LUA_MINSTACK);
   lua_assert(ci->top.p <= L->stack_last.p);
   if (l_unlikely(L->hookmask & LUA_MASKCALL)) {
     int narg = cast_int(L->top.p - func) - 1;
@@ -668,6 +788,16 @@ l_sinline int precallC (lua_State *L, StkId func, unsigned status,
 }
 
 
+/*
+** Erase registers 'from' to 'to' (not included) of a new frame
+** (see 'clearprivregs').
+*/
+void luaD_clearregs (StkId from, StkId to) {
+  for (; from < to; from++)
+    setnilvalue(s2v(from));
+}
+
+
 /*
 ** Prepare a function for a tail call, building its call info on top
 ** of the current call info. 'narg1' is the number of arguments plus 1
@@ -696,6 +826,7 @@ int luaD_pretailcall (lua_State *L, CallInfo *ci, StkId func,
       for (; narg1 <= nfixparams; narg1++)
         setnilvalue(s2v(func + narg1));  /* complete missing arguments */
       ci->top.p = func + 1 + fsize;  /* top for new function */
+      clearprivregs(p, func + narg1, ci->top.p);
       lua_assert(ci->top.p <= L->stack_last.p);
       ci->u.l.savedpc = p->code;  /* starting point */
       ci->callstatus |= CIST_TAIL;
@@ -732,18 +863,9 @@ CallInfo *luaD_precall (lua_State *L, StkId func, int nresults) {
       precallC(L, func, status, fvalue(s2v(func)));
       return NULL;
     case LUA_VLCL: {  /* Lua function */
-      CallInfo *ci;
       Proto *p = clLvalue(s2v(func))->p;
-      int narg = cast_int(L->top.p - func) - 1;  /* number of real arguments */
-      int nfixparams = p->numparams;
-      int fsize = p->maxstacksize;  /* frame size */
-      checkstackp(L, fsize, func);
-      L->ci = ci = prepCallInfo(L, func, status, func + 1 + fsize);
-      ci->u.l.savedpc = p->code;  /* starting point */
-      for (; narg < nfixparams; narg++)
-        setnilvalue(s2v(L->top.p++));  /* complete missing arguments */
-      lua_assert(ci->top.p <= L->stack_last.p);
-      return ci;
+      checkstackp(L, p->maxstacksize, func);
+      return luaD_precallLua(L, func, status, p);
     }
     default: {  /* not a function */
       checkstackp(L, 1, func);  /* space for metamethod */
@@ -974,6 +1096,7 @@ static TStatus precover (lua_State *L, TStatus status) {
 LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs,
                                       int *nresults) {
   TStatus status;
+  lua_State *running;
   lua_lock(L);
   if (L->status == LUA_OK) {  /* may be starting a coroutine */
     if (L->ci != &L->base_ci)  /* not in base level? */
@@ -989,7 +1112,10 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs,
   L->nCcalls++;
   luai_userstateresume(L, nargs);
   api_checkpop(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
+  running = G(L)->running;
+  G(L)->running = L;  /* coroutine is running now */
   status = luaD_rawrunprotected(L, resume, &nargs);
+  G(L)->running = running;  /* back to resumer */
    /* continue running after recoverable errors */
   status = precover(L, status);
   if (l_likely(!errorstatus(status)))
@@ -1142,8 +1268,11 @@ static void f_parser (lua_State *L, void *ud) {
     cl = luaU_undump(L, p->z, p->name, fixed);
   }
   else {
+    int optimize = (strchr(mode, 'O') != NULL);  /* optimize code? */
     checkmode(L, mode, "text");
-    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c, optimize);
+    if (optimize)
+      luaK_optimize(L, cl->p, &p->buff);
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
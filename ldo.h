@@ -53,6 +53,19 @@
     p = restorestack(L, t__))  /* 'pos' part: restore 'p' */
 
 
+/* next CallInfo in the list (allocating it if needed) */
+#define next_ci(L)  (L->ci->next ? L->ci->next : luaE_extendCI(L, 1))
+
+
+/*
+** Erase registers 'from' to 'to' (not included) of a new activation of
+** function 'p' if it has private tables (see OP_NEWTABLEP), which must
+** not find in its registers private tables left there by other frames.
+*/
+#define clearprivregs(p,from,to)  \
+	{ if (l_unlikely((p)->flag & PF_PRIVTAB)) luaD_clearregs(from, to); }
+
+
 /*
 ** Maximum depth for nested C calls, syntactical nested non-terminals,
 ** and other features implemented through recursion in C. (Value must
@@ -75,6 +88,7 @@ LUAI_FUNC TStatus luaD_protectedparser (lua_State *L, ZIO *z,
 LUAI_FUNC void luaD_hook (lua_State *L, int event, int line,
                                         int fTransfer, int nTransfer);
 LUAI_FUNC void luaD_hookcall (lua_State *L, CallInfo *ci);
+LUAI_FUNC void luaD_clearregs (StkId from, StkId to);
 LUAI_FUNC int luaD_pretailcall (lua_State *L, CallInfo *ci, StkId func,
                                               int narg1, int delta);
 LUAI_FUNC CallInfo *luaD_precall (lua_State *L, StkId func, int nResults);
@@ -86,6 +100,7 @@ LUAI_FUNC TStatus luaD_pcall (lua_State *L, Pfunc func, void *u,
                                         ptrdiff_t oldtop, ptrdiff_t ef);
 LUAI_FUNC void luaD_poscall (lua_State *L, CallInfo *ci, int nres);
 LUAI_FUNC int luaD_reallocstack (lua_State *L, int newsize, int raiseerror);
+LUAI_FUNC void luaD_freestack (lua_State *L);
 LUAI_FUNC int luaD_growstack (lua_State *L, int n, int raiseerror);
 LUAI_FUNC void luaD_shrinkstack (lua_State *L);
 LUAI_FUNC void luaD_inctop (lua_State *L);
@@ -95,5 +110,43 @@ LUAI_FUNC l_noret luaD_throw (lua_State *L, TStatus errcode);
 LUAI_FUNC l_noret luaD_throwbaselevel (lua_State *L, TStatus errcode);
 LUAI_FUNC TStatus luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud);
 
+
+/*
+** Allocate and initialize CallInfo structure. At this point, the
+** only valid fields in the call status are number of results,
+** CIST_C (if it's a C function), and number of extra arguments.
+** (All these bit-fields fit in 16-bit values.)
+*/
+l_sinline CallInfo *luaD_prepCallInfo (lua_State *L, StkId func,
+                                       unsigned status, StkId top) {
+  CallInfo *ci = L->ci = next_ci(L);  /* new frame */
+  ci->func.p = func;
+  lua_assert((status & ~(CIST_NRESULTS | CIST_C | MAX_CCMT)) == 0);
+  ci->callstatus = status;
+  ci->top.p = top;
+  return ci;
+}
+
+
+/*
+** Build the frame for a call to the Lua function 'p' at 'func', with
+** its arguments up to 'L->top'. The caller must have ensured stack
+** space for the frame. Used by 'luaD_precall' and by the fast path of
+** OP_CALL in 'luaV_execute'.
+*/
+l_sinline CallInfo *luaD_precallLua (lua_State *L, StkId func,
+                                     unsigned status, Proto *p) {
+  int narg = cast_int(L->top.p - func) - 1;  /* number of real arguments */
+  int nfixparams = p->numparams;
+  CallInfo *ci = luaD_prepCallInfo(L, func, status,
+                                      func + 1 + p->maxstacksize);
+  ci->u.l.savedpc = p->code;  /* starting point */
+  for (; narg < nfixparams; narg++)
+    setnilvalue(s2v(L->top.p++));  /* complete missing arguments */
+  clearprivregs(p, L->top.p, ci->top.p);
+  lua_assert(ci->top.p <= L->stack_last.p);
+  return ci;
+}
+
 #endif
 
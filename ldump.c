@@ -18,6 +18,7 @@
 #include "lapi.h"
 #include "lgc.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "ltable.h"
 #include "lundump.h"
@@ -168,11 +169,28 @@ static void dumpString (DumpState *D, TString *ts) {
 }
 
 
+/* size of the buffer used to dump code */
+#define CODEBUFF	64
+
+/*
+** Dump the code of a function. Quickened instructions are dumped back
+** in their generic form, so the dump does not depend on the values
+** seen by previous executions.
+*/
 static void dumpCode (DumpState *D, const Proto *f) {
-  dumpInt(D, f->sizecode);
+  Instruction buff[CODEBUFF];
+  int n = f->sizecode;
+  int i;
+  dumpInt(D, n);
   dumpAlign(D, sizeof(f->code[0]));
   lua_assert(f->code != NULL);
-  dumpVector(D, f->code, cast_uint(f->sizecode));
+  for (i = 0; i < n; i += CODEBUFF) {
+    int m = (n - i < CODEBUFF) ? n - i : CODEBUFF;
+    int j;
+    for (j = 0; j < m; j++)
+      buff[j] = luaP_unquicken(f->code[i + j]);
+    dumpVector(D, buff, cast_uint(m));
+  }
 }
 
 
@@ -20,6 +20,7 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 
 
@@ -253,13 +254,18 @@ Proto *luaF_newproto (lua_State *L) {
   f->sizelineinfo = 0;
   f->abslineinfo = NULL;
   f->sizeabslineinfo = 0;
+  f->lineidx = NULL;
   f->upvalues = NULL;
   f->sizeupvalues = 0;
   f->numparams = 0;
   f->flag = 0;
   f->maxstacksize = 0;
+  f->cachemiss = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
+  f->icache = NULL;
+  f->sizeicache = 0;
+  f->cache = NULL;
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
@@ -272,7 +278,10 @@ lu_mem luaF_protosize (Proto *p) {
             + cast_uint(p->sizep) * sizeof(Proto*)
             + cast_uint(p->sizek) * sizeof(TValue)
             + cast_uint(p->sizelocvars) * sizeof(LocVar)
-            + cast_uint(p->sizeupvalues) * sizeof(Upvaldesc);
+            + cast_uint(p->sizeupvalues) * sizeof(Upvaldesc)
+            + cast_uint(p->sizeicache) * sizeof(unsigned int);
+  if (p->lineidx != NULL)
+    sz += cast_uint(p->sizelineinfo) * sizeof(int);
   if (!(p->flag & PF_FIXED)) {
     sz += cast_uint(p->sizecode) * sizeof(Instruction);
     sz += cast_uint(p->sizelineinfo) * sizeof(lu_byte);
@@ -288,14 +297,55 @@ void luaF_freeproto (lua_State *L, Proto *f) {
     luaM_freearray(L, f->lineinfo, cast_sizet(f->sizelineinfo));
     luaM_freearray(L, f->abslineinfo, cast_sizet(f->sizeabslineinfo));
   }
+  if (f->lineidx != NULL)
+    luaM_freearray(L, f->lineidx, cast_sizet(f->sizelineinfo));
   luaM_freearray(L, f->p, cast_sizet(f->sizep));
   luaM_freearray(L, f->k, cast_sizet(f->sizek));
   luaM_freearray(L, f->locvars, cast_sizet(f->sizelocvars));
   luaM_freearray(L, f->upvalues, cast_sizet(f->sizeupvalues));
+  luaM_freearray(L, f->icache, cast_sizet(f->sizeicache));
   luaM_free(L, f);
 }
 
 
+/*
+** Instructions that index a table with a constant short-string key
+** use an inline cache (see 'luaV_execute').
+*/
+static int usesicache (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_GETTABUP: case OP_GETFIELD: case OP_SELF:
+    case OP_SETTABUP: case OP_SETFIELD:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+
+/*
+** Create the inline caches of a prototype, with one entry for each
+** instruction, if the prototype has some instruction that uses them.
+** Prototypes with fixed code are meant to use little memory, so they
+** get only one entry, shared by all their instructions. Entries are
+** only hints, so their initial values are irrelevant.
+*/
+void luaF_newicache (lua_State *L, Proto *f) {
+  int i;
+  lua_assert(f->icache == NULL);
+  for (i = 0; i < f->sizecode; i++) {
+    if (usesicache(f->code[i])) {  /* needs caches? */
+      int n = (f->flag & PF_FIXED) ? 1 : f->sizecode;
+      f->icache = luaM_newvector(L, n, unsigned int);
+      for (i = 0; i < n; i++)
+        f->icache[i] = 0;
+      f->sizeicache = n;
+      return;
+    }
+  }
+}
+
+
 /*
 ** Look for n-th local variable at line 'line' in function 'func'.
 ** Returns NULL if not found.
@@ -148,6 +148,8 @@ static l_mem objsize (GCObject *o) {
     case LUA_VLNGSTR: {
       TString *ts = gco2ts(o);
       res = luaS_sizelngstr(ts->u.lnglen, ts->shrlen);
+      if (ts->shrlen == LSTRBUF && getstrbuff(ts)->nrefs == 1)
+        res += sizestrbuff(getstrbuff(ts)->size);  /* owns its buffer */
       break;
     }
     case LUA_VUPVAL: {
@@ -317,6 +319,104 @@ GCObject *luaC_newobj (lua_State *L, lu_byte tt, size_t sz) {
 
 
 
+/*
+** {======================================================
+** Statistics
+** =======================================================
+*/
+
+/*
+** 'luai_gcclock' gives the current time in microseconds. It is read
+** only at the start and end of each step and at phase changes.
+*/
+#if !defined(luai_gcclock)
+
+#include <time.h>
+
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+
+static lua_Integer gcclock (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(lua_Integer, ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#define luai_gcclock()	gcclock()
+
+#else
+
+#define luai_gcclock()  \
+	cast(lua_Integer, cast(double, clock()) * (1e6 / CLOCKS_PER_SEC))
+
+#endif
+
+#endif
+
+
+/* statistics of the collection in progress */
+#define gcstats(g)	((g)->gcstats.cur)
+
+
+/* phase (for statistics) of each collector state */
+static const lu_byte statephase[] = {
+  LUA_GCSPROPAGATE,  /* GCSpropagate */
+  LUA_GCSATOMIC,  /* GCSenteratomic */
+  LUA_GCSATOMIC,  /* GCSatomic */
+  LUA_GCSSWEEP,  /* GCSswpallgc */
+  LUA_GCSSWEEP,  /* GCSswpfinobj */
+  LUA_GCSSWEEP,  /* GCSswptobefnz */
+  LUA_GCSSWEEP,  /* GCSswpend */
+  LUA_GCSCALLFIN,  /* GCScallfin */
+  LUA_GCSPROPAGATE  /* GCSpause (leaving it marks the root set) */
+};
+
+
+static void statstart (global_State *g) {
+  g->gcstats.tstep = g->gcstats.tphase = luai_gcclock();
+}
+
+
+/*
+** Charge the time since the last phase change to 'phase'.
+*/
+static void statphase (global_State *g, int phase) {
+  lua_Integer now = luai_gcclock();
+  gcstats(g)[phase] += now - g->gcstats.tphase;
+  g->gcstats.tphase = now;
+}
+
+
+/*
+** Finish timing a step. If the step finished a collection ('done'
+** is LUA_GCSMAJOR or LUA_GCSMINOR), its statistics go to 'last' and
+** are added to 'total'.
+*/
+static void statend (global_State *g) {
+  GCStats *st = &g->gcstats;
+  lua_Integer step;
+  statphase(g, statephase[g->gcstate]);
+  step = st->tphase - st->tstep;
+  if (step > st->cur[LUA_GCSMAXSTEP])
+    st->cur[LUA_GCSMAXSTEP] = step;
+  if (st->done) {
+    int i;
+    st->cur[st->done] = 1;
+    for (i = 0; i < LUA_GCSN; i++) {
+      st->last[i] = st->cur[i];
+      if (i != LUA_GCSMAXSTEP)
+        st->total[i] += st->cur[i];
+      else if (st->cur[i] > st->total[i])
+        st->total[i] = st->cur[i];
+      st->cur[i] = 0;
+    }
+    st->done = 0;
+  }
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** Mark functions
@@ -439,6 +539,7 @@ static void cleargraylists (global_State *g) {
 */
 static void restartcollection (global_State *g) {
   cleargraylists(g);
+  g->gcremarked = 0;
   g->GCmarked = 0;
   markobject(g, mainthread(g));
   markvalue(g, &g->l_registry);
@@ -597,9 +698,13 @@ static int getmode (global_State *g, Table *h) {
   if (mode == NULL || !ttisstring(mode))
     return 0;  /* ignore non-string modes */
   else {
-    const char *smode = getstr(tsvalue(mode));
-    const char *weakkey = strchr(smode, 'k');
-    const char *weakvalue = strchr(smode, 'v');
+    TString *ts = tsvalue(mode);
+    const char *weakkey, *weakvalue;
+    char c = '\0';
+    luaS_setend(ts, c);  /* 'strchr' needs the final '\0' */
+    weakkey = strchr(getstr(ts), 'k');
+    weakvalue = strchr(getstr(ts), 'v');
+    luaS_resetend(ts, c);
     return ((weakkey != NULL) << 1) | (weakvalue != NULL);
   }
 }
@@ -643,8 +748,17 @@ static l_mem traverseudata (global_State *g, Udata *u) {
 ** arrays can be larger than needed; the extra slots are filled with
 ** NULL, so the use of 'markobjectN')
 */
+/*
+** Traverse a prototype. The cache of closures is a weak reference: if
+** the cached closure is not marked yet, the cache is cleared, so that
+** the closure can be collected. (Any assignment to the cache of a
+** black prototype goes through a barrier, so a prototype always sees
+** the final state of its cache in the atomic phase.)
+*/
 static l_mem traverseproto (global_State *g, Proto *f) {
   int i;
+  if (f->cache && iswhite(f->cache))
+    f->cache = NULL;  /* allow cache to be collected */
   markobjectN(g, f->source);
   for (i = 0; i < f->sizek; i++)  /* mark literals */
     markvalue(g, &f->k[i]);
@@ -654,6 +768,7 @@ static l_mem traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
+  genlink(g, obj2gco(f));  /* cache may have been set through a barrier */
   return 1 + f->sizek + f->sizeupvalues + f->sizep + f->sizelocvars;
 }
 
@@ -873,6 +988,8 @@ static void freeobj (lua_State *L, GCObject *o) {
       TString *ts = gco2ts(o);
       if (ts->shrlen == LSTRMEM)  /* must free external string? */
         (*ts->falloc)(ts->ud, ts->contents, ts->u.lnglen + 1, 0);
+      else if (ts->shrlen == LSTRBUF)  /* string in a buffer? */
+        luaS_freebuff(L, getstrbuff(ts));
       luaM_freemem(L, ts, luaS_sizelngstr(ts->u.lnglen, ts->shrlen));
       break;
     }
@@ -893,18 +1010,24 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, l_mem countin) {
   global_State *g = G(L);
   int ow = otherwhite(g);
   int white = luaC_white(g);  /* current white */
-  while (*p != NULL && countin-- > 0) {
+  l_mem swept = 0;
+  l_mem freed = 0;
+  while (*p != NULL && swept < countin) {
     GCObject *curr = *p;
     int marked = curr->marked;
+    swept++;
     if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
+      freed++;
     }
     else {  /* change mark to 'white' and age to 'new' */
       curr->marked = cast_byte((marked & ~maskgcbits) | white | G_NEW);
       p = &curr->next;  /* go to next element */
     }
   }
+  gcstats(g)[LUA_GCSSWEPT] += swept;
+  gcstats(g)[LUA_GCSFREED] += freed;
   return (*p == NULL) ? NULL : p;
 }
 
@@ -1136,11 +1259,15 @@ static void setpause (global_State *g) {
 static void sweep2old (lua_State *L, GCObject **p) {
   GCObject *curr;
   global_State *g = G(L);
+  l_mem swept = 0;
+  l_mem freed = 0;
   while ((curr = *p) != NULL) {
+    swept++;
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
+      freed++;
     }
     else {  /* all surviving objects become old */
       setage(curr, G_OLD);
@@ -1155,6 +1282,8 @@ static void sweep2old (lua_State *L, GCObject **p) {
       p = &curr->next;  /* go to next element */
     }
   }
+  gcstats(g)[LUA_GCSSWEPT] += swept;
+  gcstats(g)[LUA_GCSFREED] += freed;
 }
 
 
@@ -1182,13 +1311,17 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
     G_TOUCHED2   /* from G_TOUCHED2 (do not change) */
   };
   l_mem addedold = 0;
+  l_mem swept = 0;
+  l_mem freed = 0;
   int white = luaC_white(g);
   GCObject *curr;
   while ((curr = *p) != limit) {
+    swept++;
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(!isold(curr) && isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
+      freed++;
     }
     else {  /* correct mark and age */
       int age = getage(curr);
@@ -1209,6 +1342,8 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
     }
   }
   *paddedold += addedold;
+  gcstats(g)[LUA_GCSSWEPT] += swept;
+  gcstats(g)[LUA_GCSFREED] += freed;
   return p;
 }
 
@@ -1293,8 +1428,11 @@ static void finishgencycle (lua_State *L, global_State *g) {
   correctgraylists(g);
   checkSizes(L, g);
   g->gcstate = GCSpropagate;  /* skip restart */
-  if (g->tobefnz != NULL && !g->gcemergency && luaD_checkminstack(L))
+  statphase(g, LUA_GCSSWEEP);
+  if (g->tobefnz != NULL && !g->gcemergency && luaD_checkminstack(L)) {
     callallpendingfinalizers(L);
+    statphase(g, LUA_GCSCALLFIN);
+  }
 }
 
 
@@ -1346,6 +1484,7 @@ static void youngcollection (lua_State *L, global_State *g) {
   markold(g, g->tobefnz, NULL);
 
   atomic(L);  /* will lose 'g->marked' */
+  gcstats(g)[LUA_GCSMARKED] = g->GCmarked - marked;
 
   /* sweep nursery and get a pointer to its last live element */
   g->gcstate = GCSswpallgc;
@@ -1369,6 +1508,7 @@ static void youngcollection (lua_State *L, global_State *g) {
 
   /* keep total number of added old1 bytes */
   g->GCmarked = marked + addedold1;
+  g->gcstats.done = LUA_GCSMINOR;
 
   /* decide whether to shift to major mode */
   if (checkminormajor(g)) {
@@ -1402,6 +1542,7 @@ static void atomic2gen (lua_State *L, global_State *g) {
   sweep2old(L, &g->tobefnz);
 
   g->gckind = KGC_GENMINOR;
+  g->gcstats.done = LUA_GCSMAJOR;
   g->GCmajorminor = g->GCmarked;  /* "base" for number of bytes */
   g->GCmarked = 0;  /* to count the number of added old1 bytes */
   finishgencycle(L, g);
@@ -1429,6 +1570,7 @@ static void entergen (lua_State *L, global_State *g) {
   luaC_runtilstate(L, GCSpause, 1);  /* prepare to start a new cycle */
   luaC_runtilstate(L, GCSpropagate, 1);  /* start new cycle */
   atomic(L);  /* propagates all and then do the atomic stuff */
+  gcstats(g)[LUA_GCSMARKED] = g->GCmarked;
   atomic2gen(L, g);
   setminordebt(g);  /* set debt assuming next cycle will be minor */
 }
@@ -1442,12 +1584,14 @@ void luaC_changemode (lua_State *L, int newmode) {
   if (g->gckind == KGC_GENMAJOR)  /* doing major collections? */
     g->gckind = KGC_INC;  /* already incremental but in name */
   if (newmode != g->gckind) {  /* does it need to change? */
+    statstart(g);
     if (newmode == KGC_INC)  /* entering incremental mode? */
       minor2inc(L, g, KGC_INC);  /* entering incremental mode */
     else {
       lua_assert(newmode == KGC_GENMINOR);
       entergen(L, g);
     }
+    statend(g);
   }
 }
 
@@ -1547,6 +1691,7 @@ static void atomic (lua_State *L) {
   g->grayagain = NULL;
   lua_assert(g->ephemeron == NULL && g->weak == NULL);
   lua_assert(!iswhite(mainthread(g)));
+  statphase(g, LUA_GCSPROPAGATE);  /* marking done before atomic */
   g->gcstate = GCSatomic;
   markobject(g, L);  /* mark running thread */
   /* registry and global metatables may be changed by API */
@@ -1578,6 +1723,7 @@ static void atomic (lua_State *L) {
   luaS_clearcache(g);
   g->currentwhite = cast_byte(otherwhite(g));  /* flip current white */
   lua_assert(g->gray == NULL);
+  statphase(g, LUA_GCSATOMIC);
 }
 
 
@@ -1616,6 +1762,7 @@ static void sweepstep (lua_State *L, global_State *g,
 
 static l_mem singlestep (lua_State *L, int fast) {
   global_State *g = G(L);
+  lu_byte oldstate = g->gcstate;
   l_mem stepresult;
   lua_assert(!g->gcstopem);  /* collector is not reentrant */
   g->gcstopem = 1;  /* no emergency collections while collecting */
@@ -1627,7 +1774,17 @@ static l_mem singlestep (lua_State *L, int fast) {
       break;
     }
     case GCSpropagate: {
-      if (fast || g->gray == NULL) {
+      if (!fast && g->gray == NULL && g->grayagain != NULL &&
+          g->gckind == KGC_INC && !g->gcremarked) {
+        /* traverse again, incrementally, objects touched by barriers
+           during this cycle; the atomic phase will have to traverse
+           only those touched again after that */
+        g->gcremarked = 1;
+        g->gray = g->grayagain;
+        g->grayagain = NULL;
+        stepresult = 1;
+      }
+      else if (fast || g->gray == NULL) {
         g->gcstate = GCSenteratomic;  /* finish propagate phase */
         stepresult = 1;
       }
@@ -1637,6 +1794,7 @@ static l_mem singlestep (lua_State *L, int fast) {
     }
     case GCSenteratomic: {
       atomic(L);
+      gcstats(g)[LUA_GCSMARKED] = g->GCmarked;
       if (checkmajorminor(L, g))
         stepresult = step2minor;
       else {
@@ -1675,12 +1833,15 @@ static l_mem singlestep (lua_State *L, int fast) {
       else {  /* no more finalizers or emergency mode or not enough stack
                  to run finalizers */
         g->gcstate = GCSpause;  /* finish collection */
+        g->gcstats.done = LUA_GCSMAJOR;
         stepresult = step2pause;
       }
       break;
     }
     default: lua_assert(0); return 0;
   }
+  if (g->gcstate != oldstate)  /* changed phase? */
+    statphase(g, statephase[oldstate]);
   g->gcstopem = 0;
   return stepresult;
 }
@@ -1700,6 +1861,55 @@ void luaC_runtilstate (lua_State *L, int state, int fast) {
 
 
 
+/*
+** Amount of work between two checks of the clock in a timed step
+*/
+#define GCTIMECHECK	256
+
+
+/*
+** Performs an incremental step that runs single steps until it has
+** used 'steptime' microseconds, or until it finishes a cycle or the
+** atomic phase. The atomic phase is indivisible, so a step that did
+** some work stops before it, leaving the atomic phase to a step of
+** its own. Finalizers can take any time, so the clock is checked
+** after each one. The debt for the next step is proportional to the
+** work actually done, at the rate given by 'stepsize' and 'work2do':
+** a step that did more work than 'work2do' waits for more allocation,
+** and one that did less runs again sooner, so that the collector
+** keeps up with the program.
+*/
+static void timedstep (lua_State *L, global_State *g, l_mem stepsize,
+                       l_mem work2do, l_mem steptime) {
+  lua_Integer limit = luai_gcclock() + steptime;
+  l_mem done = 0;  /* work done in this step */
+  l_mem check = 0;  /* work done since last check of the clock */
+  for (;;) {
+    l_mem stres = singlestep(L, 0);
+    if (stres == step2minor)  /* returned to minor collections? */
+      return;  /* nothing else to be done here */
+    else if (stres == step2pause || stres == atomicstep)
+      break;  /* end of cycle or atomic */
+    done += stres;
+    check += stres;
+    if (g->gcstate == GCSenteratomic)
+      break;  /* leave atomic phase to next step */
+    else if (check >= GCTIMECHECK || g->gcstate == GCScallfin) {
+      check = 0;
+      if (luai_gcclock() >= limit)
+        break;  /* budget used up */
+    }
+  }
+  if (g->gcstate == GCSpause)
+    setpause(g);  /* pause until next cycle */
+  else if (done == 0)  /* step did only the atomic phase? */
+    luaE_setdebt(g, stepsize);
+  else  /* 'stepsize' bytes for each 'work2do' units of work */
+    luaE_setdebt(g, (done / work2do) * stepsize +
+                    (done % work2do) * stepsize / work2do);
+}
+
+
 /*
 ** Performs a basic incremental step. The step size is
 ** converted from bytes to "units of work"; then the function loops
@@ -1710,8 +1920,13 @@ void luaC_runtilstate (lua_State *L, int state, int fast) {
 static void incstep (lua_State *L, global_State *g) {
   l_mem stepsize = applygcparam(g, STEPSIZE, 100);
   l_mem work2do = applygcparam(g, STEPMUL, stepsize / cast_int(sizeof(void*)));
+  l_mem steptime = applygcparam(g, STEPTIME, 100);
   l_mem stres;
   int fast = (work2do == 0);  /* special case: do a full collection */
+  if (steptime > 0 && !fast) {  /* time-budgeted steps? */
+    timedstep(L, g, stepsize, work2do, steptime);
+    return;
+  }
   do {  /* repeat until enough work */
     stres = singlestep(L, fast);  /* perform one single step */
     if (stres == step2minor)  /* returned to minor collections? */
@@ -1746,6 +1961,7 @@ void luaC_step (lua_State *L) {
   }
   else {
     luai_tracegc(L, 1);  /* for internal debugging */
+    statstart(g);
     switch (g->gckind) {
       case KGC_INC: case KGC_GENMAJOR:
         incstep(L, g);
@@ -1755,6 +1971,7 @@ void luaC_step (lua_State *L) {
         setminordebt(g);
         break;
     }
+    statend(g);
     luai_tracegc(L, 0);  /* for internal debugging */
   }
 }
@@ -1787,6 +2004,7 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
   g->gcemergency = cast_byte(isemergency);  /* set flag */
+  statstart(g);
   switch (g->gckind) {
     case KGC_GENMINOR: fullgen(L, g); break;
     case KGC_INC: fullinc(L, g); break;
@@ -1796,6 +2014,7 @@ void luaC_fullgc (lua_State *L, int isemergency) {
       g->gckind = KGC_GENMAJOR;
       break;
   }
+  statend(g);
   g->gcemergency = 0;
 }
 
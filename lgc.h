@@ -200,6 +200,12 @@
 /* How many bytes to allocate before next GC step */
 #define LUAI_GCSTEPSIZE	(200 * sizeof(Table))
 
+/*
+** Time budget for each GC step, in microseconds. When not zero, each
+** step runs for that long, instead of doing a fixed amount of work.
+*/
+#define LUAI_GCSTEPTIME	0
+
 
 #define setgcparam(g,p,v)  (g->gcparams[LUA_GCP##p] = luaO_codeparam(v))
 #define applygcparam(g,p,x)  luaO_applyparam(g->gcparams[LUA_GCP##p], x)
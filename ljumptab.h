@@ -109,6 +109,19 @@ static const void *const disptab[NUM_OPCODES] = {
 &&L_OP_GETVARG,
 &&L_OP_ERRNNIL,
 &&L_OP_VARARGPREP,
-&&L_OP_EXTRAARG
+&&L_OP_EXTRAARG,
+&&L_OP_ADDINT,
+&&L_OP_ADDFLT,
+&&L_OP_SUBINT,
+&&L_OP_SUBFLT,
+&&L_OP_MULINT,
+&&L_OP_MULFLT,
+&&L_OP_EQINT,
+&&L_OP_LTINT,
+&&L_OP_LTFLT,
+&&L_OP_LEINT,
+&&L_OP_LEFLT,
+&&L_OP_GETTABINT,
+&&L_OP_NEWTABLEP
 
 };
@@ -106,6 +106,19 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 0, 0, 0, 0, iABx)		/* OP_ERRNNIL */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_EQINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABINT */
+ ,opmode(0, 0, 0, 0, 1, ivABC)		/* OP_NEWTABLEP */
 };
 
 
@@ -138,3 +151,28 @@ int luaP_isIT (Instruction i) {
   }
 }
 
+
+/*
+** Return the generic version of an instruction, as the compiler
+** generated it: quickened opcodes go back to their generic opcodes,
+** and marks against quickening are erased.
+*/
+Instruction luaP_unquicken (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_GETTABLE:
+      SETARG_k(i, 0);
+      break;
+    case OP_EQ: case OP_LT: case OP_LE:
+      SETARG_C(i, 0);
+      break;
+    case OP_ADDINT: case OP_ADDFLT: SET_OPCODE(i, OP_ADD); break;
+    case OP_SUBINT: case OP_SUBFLT: SET_OPCODE(i, OP_SUB); break;
+    case OP_MULINT: case OP_MULFLT: SET_OPCODE(i, OP_MUL); break;
+    case OP_EQINT: SET_OPCODE(i, OP_EQ); break;
+    case OP_LTINT: case OP_LTFLT: SET_OPCODE(i, OP_LT); break;
+    case OP_LEINT: case OP_LEFLT: SET_OPCODE(i, OP_LE); break;
+    case OP_GETTABINT: SET_OPCODE(i, OP_GETTABLE); break;
+    default: break;
+  }
+  return i;
+}
@@ -344,11 +344,33 @@ OP_ERRNNIL,/*	A Bx	raise error if R[A] ~= nil (K[Bx - 1] is global name)*/
 
 OP_VARARGPREP,/* 	(adjust varargs)				*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* quickened opcodes (created only by the interpreter; see lvm.c) */
+OP_ADDINT,/*	A B C	R[A] := R[B] + R[C] (integers)			*/
+OP_ADDFLT,/*	A B C	R[A] := R[B] + R[C] (floats)			*/
+OP_SUBINT,/*	A B C	R[A] := R[B] - R[C] (integers)			*/
+OP_SUBFLT,/*	A B C	R[A] := R[B] - R[C] (floats)			*/
+OP_MULINT,/*	A B C	R[A] := R[B] * R[C] (integers)			*/
+OP_MULFLT,/*	A B C	R[A] := R[B] * R[C] (floats)			*/
+
+OP_EQINT,/*	A B k	if ((R[A] == R[B]) ~= k) then pc++ (integers)	*/
+OP_LTINT,/*	A B k	if ((R[A] <  R[B]) ~= k) then pc++ (integers)	*/
+OP_LTFLT,/*	A B k	if ((R[A] <  R[B]) ~= k) then pc++ (floats)	*/
+OP_LEINT,/*	A B k	if ((R[A] <= R[B]) ~= k) then pc++ (integers)	*/
+OP_LEFLT,/*	A B k	if ((R[A] <= R[B]) ~= k) then pc++ (floats)	*/
+
+OP_GETTABINT,/*	A B C	R[A] := R[B][R[C]] (table and integer key)	*/
+
+/* opcodes created only by the bytecode optimizer (see lcode.c) */
+OP_NEWTABLEP/*	A vB vC k	R[A] := {} (may reuse private table in R[A]) */
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_NEWTABLEP) + 1)
+
+/* test whether an opcode is a quickened one */
+#define isquickened(op)		((op) > OP_EXTRAARG)
 
 
 
@@ -376,8 +398,8 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
   (*) In OP_RETURN, if (B == 0) then return up to 'top'.
 
-  (*) In OP_LOADKX and OP_NEWTABLE, the next instruction is always
-  OP_EXTRAARG.
+  (*) In OP_LOADKX, OP_NEWTABLE, and OP_NEWTABLEP, the next instruction
+  is always OP_EXTRAARG.
 
   (*) In OP_SETLIST, if (B == 0) then real B = 'top'; if k, then
   real C = EXTRAARG _ C (the bits of EXTRAARG concatenated with the
@@ -387,6 +409,15 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   power of 2) plus 1, or zero for size zero. If not k, the array size
   is vC. Otherwise, the array size is EXTRAARG _ vC.
 
+  (*) OP_NEWTABLEP is OP_NEWTABLE for a register whose values never
+  escape from it. When R[A] already has a table created by some
+  OP_NEWTABLEP (a private table), nothing else can refer to that table,
+  so the instruction empties it, gives it the sizes of this constructor,
+  and reuses it. That table may come from a different constructor that
+  uses the same register in the same function, but not from another
+  frame: a new activation of a function with private tables erases its
+  registers (see 'clearprivregs').
+
   (*) In OP_ERRNNIL, (Bx == 0) means index of global name doesn't
   fit in Bx. (So, that name is not available for the error message.)
 
@@ -399,6 +430,15 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   (*) All comparison and test instructions assume that the instruction
   being skipped (pc++) is a jump.
 
+  (*) Quickened opcodes are specialized versions of OP_ADD, OP_SUB,
+  OP_MUL, OP_EQ, OP_LT, OP_LE, and OP_GETTABLE for some operand
+  types. The interpreter rewrites generic instructions into them, and
+  back (see lvm.c). When a quickened instruction goes back to its
+  generic version, the interpreter marks it, so that it will not be
+  quickened again: the mark is 'k' in OP_ADD/OP_SUB/OP_MUL/OP_GETTABLE
+  and C in OP_EQ/OP_LT/OP_LE. (The compiler sets none of these
+  arguments in these opcodes.)
+
   (*) In instructions OP_RETURN/OP_TAILCALL, 'k' specifies that the
   function builds upvalues, which may need to be closed. C > 0 means
   the function has hidden vararg arguments, so that its 'func' must be
@@ -434,6 +474,7 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 
 LUAI_FUNC int luaP_isOT (Instruction i);
 LUAI_FUNC int luaP_isIT (Instruction i);
+LUAI_FUNC Instruction luaP_unquicken (Instruction i);
 
 
 #endif
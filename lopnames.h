@@ -98,6 +98,19 @@ static const char *const opnames[] = {
   "ERRNNIL",
   "VARARGPREP",
   "EXTRAARG",
+  "ADDINT",
+  "ADDFLT",
+  "SUBINT",
+  "SUBFLT",
+  "MULINT",
+  "MULFLT",
+  "EQINT",
+  "LTINT",
+  "LTFLT",
+  "LEINT",
+  "LEFLT",
+  "GETTABINT",
+  "NEWTABLEP",
   NULL
 };
 
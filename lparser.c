@@ -201,6 +201,7 @@ static int new_varkind (LexState *ls, TString *name, lu_byte kind) {
   var = &dyd->actvar.arr[dyd->actvar.n++];
   var->vd.kind = kind;  /* default */
   var->vd.name = name;
+  setnilvalue(&var->k);  /* no known value (see 'localstat') */
   return dyd->actvar.n - 1 - fs->firstlocal;
 }
 
@@ -843,6 +844,7 @@ static void close_func (LexState *ls) {
   luaM_shrinkvector(L, f->p, f->sizep, fs->np, Proto *);
   luaM_shrinkvector(L, f->locvars, f->sizelocvars, fs->ndebugvars, LocVar);
   luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+  luaF_newicache(L, f);
   ls->fs = fs->prev;
   L->top.p--;  /* pop kcache table */
   luaC_checkGC(L);
@@ -1135,7 +1137,27 @@ static int explist (LexState *ls, expdesc *v) {
 }
 
 
-static void funcargs (LexState *ls, expdesc *f) {
+/*
+** Return the prototype of the function in the read-only local
+** variable 'v', if calls to it may be inlined (see 'localstat').
+*/
+static Proto *inlinable (FuncState *fs, expdesc *v) {
+  if (fs->ls->optimize && v->k == VLOCAL) {
+    Vardesc *var = getlocalvardesc(fs, v->u.var.vidx);
+    if (var->vd.kind == RDKCONST && ttisinteger(&var->k))
+      return fs->f->p[ivalue(&var->k)];
+  }
+  return NULL;
+}
+
+
+/*
+** Parse the arguments of a call to the function in 'f'. If 'fn' is
+** not NULL, the function is the variable 'fn', not yet loaded into
+** the base register 'f', and the call may be inlined. (As 'fn' is
+** read-only, loading it after the arguments is safe.)
+*/
+static void funcargs (LexState *ls, expdesc *f, expdesc *fn) {
   FuncState *fs = ls->fs;
   expdesc args;
   int base, nparams;
@@ -1175,6 +1197,15 @@ static void funcargs (LexState *ls, expdesc *f) {
       luaK_exp2nextreg(fs, &args);  /* close last argument */
     nparams = fs->freereg - (base+1);
   }
+  if (fn != NULL) {  /* function still to be loaded? */
+    if (nparams != LUA_MULTRET &&
+        luaK_inline(fs, inlinable(fs, fn), base, nparams, line)) {
+      init_exp(f, VINLINE, base);
+      fs->freereg = cast_byte(base + 1);
+      return;
+    }
+    luaK_loadfunc(fs, base, fn->u.var.ridx, nparams);
+  }
   init_exp(f, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams+1, 2));
   luaK_fixline(fs, line);
   /* call removes function and arguments and leaves one result (unless
@@ -1237,12 +1268,20 @@ static void suffixedexp (LexState *ls, expdesc *v) {
         luaX_next(ls);
         codename(ls, &key);
         luaK_self(fs, v, &key);
-        funcargs(ls, v);
+        funcargs(ls, v, NULL);
         break;
       }
       case '(': case TK_STRING: case '{' /*}*/: {  /* funcargs */
-        luaK_exp2nextreg(fs, v);
-        funcargs(ls, v);
+        if (inlinable(fs, v) != NULL) {  /* may inline the call? */
+          expdesc fn = *v;
+          init_exp(v, VNONRELOC, fs->freereg);
+          luaK_reserveregs(fs, 1);  /* base register */
+          funcargs(ls, v, &fn);
+        }
+        else {
+          luaK_exp2nextreg(fs, v);
+          funcargs(ls, v, NULL);
+        }
         break;
       }
       default: return;
@@ -1861,6 +1900,13 @@ static void localstat (LexState *ls) {
     fs->nactvar++;  /* but count it */
   }
   else {
+    if (nvars == nexps && var->vd.kind == RDKCONST && e.k == VNONRELOC &&
+        e.t == e.f && fs->pc > 0) {  /* read-only, maybe a function? */
+      Instruction i = fs->f->code[fs->pc - 1];
+      if (GET_OPCODE(i) == OP_CLOSURE && GETARG_A(i) == e.u.info)
+        /* keep its prototype, for inlining calls (see 'inlinable') */
+        setivalue(&var->k, GETARG_Bx(i));
+    }
     adjust_assign(ls, nvars, nexps, &e);
     adjustlocalvars(ls, nvars);
   }
@@ -2016,6 +2062,8 @@ static void exprstat (LexState *ls) {
   }
   else {  /* stat -> func */
     Instruction *inst;
+    if (v.v.k == VINLINE)  /* inlined call? */
+      return;  /* nothing else to do */
     check_condition(ls, v.v.k == VCALL, "syntax error");
     inst = &getinstruction(fs, &v.v);
     SETARG_C(*inst, 1);  /* call statement uses no results */
@@ -2175,7 +2223,8 @@ static void mainfunc (LexState *ls, FuncState *fs) {
 
 
 LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                       Dyndata *dyd, const char *name, int firstchar) {
+                       Dyndata *dyd, const char *name, int firstchar,
+                       int optimize) {
   LexState lexstate;
   FuncState funcstate;
   LClosure *cl = luaF_newLclosure(L, 1);  /* create main closure */
@@ -2190,6 +2239,7 @@ LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
   luaC_objbarrier(L, funcstate.f, funcstate.f->source);
   lexstate.buff = buff;
   lexstate.dyd = dyd;
+  lexstate.optimize = cast_byte(optimize);
   dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
   luaX_setinput(L, &lexstate, z, funcstate.f->source, firstchar);
   mainfunc(&lexstate, &funcstate);
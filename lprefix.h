@@ -27,6 +27,13 @@
 #define _FILE_OFFSET_BITS       64
 #endif
 
+/*
+** Allows anonymous mappings and 'madvise' for reserved stacks (ldo.c)
+*/
+#if defined(LUAI_MMAPSTACK) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #endif				/* } */
 
 
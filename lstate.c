@@ -68,61 +68,91 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 }
 
 
+/*
+** Sizes of blocks of CallInfos: the first block of a thread has
+** CIBLOCKMIN entries and each new block doubles the size of the
+** previous one, up to CIBLOCKMAX entries.
+*/
+#if !defined(CIBLOCKMIN)
+#define CIBLOCKMIN	4
+#endif
+
+#if !defined(CIBLOCKMAX)
+#define CIBLOCKMAX	256
+#endif
+
+
+/* check whether 'ci' is one of the entries of block 'b' */
+#define inblock(b,c)	((b)->ci <= (c) && (c) < (b)->ci + (b)->size)
+
+
+/*
+** Add a new block of CallInfos at the end of the 'ci' list. (The
+** current CallInfo or its next one is the last entry of the list.)
+** Returns the CallInfo after the current one.
+*/
 CallInfo *luaE_extendCI (lua_State *L, int err) {
-  CallInfo *ci;
-  ci = luaM_reallocvector(L, NULL, 0, 1, CallInfo);
-  if (l_unlikely(ci == NULL)) {  /* allocation failed? */
+  CIBlock *b = L->ciblock;
+  CallInfo *last = L->ci;
+  int n = (b == NULL) ? CIBLOCKMIN
+                      : (b->size < CIBLOCKMAX / 2) ? b->size * 2 : CIBLOCKMAX;
+  int i;
+  CIBlock *nb = cast(CIBlock *, luaM_realloc_(L, NULL, 0, sizeCIBlock(n)));
+  if (l_unlikely(nb == NULL)) {  /* allocation failed? */
     if (err)
       luaM_error(L);  /* raise the error */
     return NULL;  /* else only report it */
   }
-  ci->next = L->ci->next;
-  ci->previous = L->ci;
-  L->ci->next = ci;
-  if (ci->next)
-    ci->next->previous = ci;
-  ci->u.l.trap = 0;
-  L->nci++;
-  return ci;
+  while (last->next != NULL)  /* go to the end of the list */
+    last = last->next;
+  nb->previous = b;
+  nb->size = n;
+  for (i = 0; i < n; i++) {  /* link entries of the new block */
+    CallInfo *ci = &nb->ci[i];
+    ci->previous = (i == 0) ? last : ci - 1;
+    ci->next = (i == n - 1) ? NULL : ci + 1;
+    ci->u.l.trap = 0;
+  }
+  last->next = nb->ci;
+  L->ciblock = nb;
+  L->nci += n;
+  return L->ci->next;
+}
+
+
+/*
+** Free the last block of CallInfos of a thread, which must not be in
+** use. The list then ends at the entry before the block.
+*/
+void luaE_freelastCIblock (lua_State *L) {
+  CIBlock *b = L->ciblock;
+  L->ciblock = b->previous;
+  b->ci[0].previous->next = NULL;
+  L->nci -= b->size;
+  luaM_freemem(L, b, sizeCIBlock(b->size));
 }
 
 
 /*
-** free all CallInfo structures not in use by a thread
+** free all CallInfo structures not in use by a thread (only called
+** with 'L->ci' pointing to 'base_ci')
 */
 static void freeCI (lua_State *L) {
-  CallInfo *ci = L->ci;
-  CallInfo *next = ci->next;
-  ci->next = NULL;
-  while ((ci = next) != NULL) {
-    next = ci->next;
-    luaM_free(L, ci);
-    L->nci--;
-  }
+  lua_assert(L->ci == &L->base_ci);
+  while (L->ciblock != NULL)
+    luaE_freelastCIblock(L);
 }
 
 
 /*
-** free half of the CallInfo structures not in use by a thread,
-** keeping the first one.
+** Free the blocks of CallInfos not in use by a thread, keeping the
+** block with the current CallInfo and at most one free block after it.
 */
 void luaE_shrinkCI (lua_State *L) {
-  CallInfo *ci = L->ci->next;  /* first free CallInfo */
-  CallInfo *next;
-  if (ci == NULL)
-    return;  /* no extra elements */
-  while ((next = ci->next) != NULL) {  /* two extra elements? */
-    CallInfo *next2 = next->next;  /* next's next */
-    ci->next = next2;  /* remove next from the list */
-    L->nci--;
-    luaM_free(L, next);  /* free next */
-    if (next2 == NULL)
-      break;  /* no more elements */
-    else {
-      next2->previous = ci;
-      ci = next2;  /* continue */
-    }
-  }
+  CIBlock *b;
+  while ((b = L->ciblock) != NULL && b->previous != NULL &&
+         !inblock(b, L->ci) && !inblock(b->previous, L->ci))
+    luaE_freelastCIblock(L);
 }
 
 
@@ -180,8 +210,7 @@ static void freestack (lua_State *L) {
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   freeCI(L);
   lua_assert(L->nci == 0);
-  /* free stack */
-  luaM_freearray(L, L->stack.p, cast_sizet(stacksize(L) + EXTRA_STACK));
+  luaD_freestack(L);  /* free stack */
 }
 
 
@@ -230,6 +259,7 @@ static void f_luaopen (lua_State *L, void *ud) {
 static void preinit_thread (lua_State *L, global_State *g) {
   G(L) = g;
   L->stack.p = NULL;
+  L->mmstack = 0;
   L->ci = NULL;
   L->nci = 0;
   L->twups = L;  /* thread has no upvalues */
@@ -240,17 +270,23 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->basehookcount = 0;
   L->allowhook = 1;
   resethookcount(L);
+  L->basebudget = 0;
+  L->budgethook = NULL;
+  resetbudget(L);
   L->openupval = NULL;
   L->status = LUA_OK;
   L->errfunc = 0;
   L->oldpc = 0;
   L->base_ci.previous = L->base_ci.next = NULL;
+  L->ciblock = NULL;
 }
 
 
 lu_mem luaE_threadsize (lua_State *L) {
-  lu_mem sz = cast(lu_mem, sizeof(LX))
-            + cast_uint(L->nci) * sizeof(CallInfo);
+  lu_mem sz = cast(lu_mem, sizeof(LX));
+  CIBlock *b;
+  for (b = L->ciblock; b != NULL; b = b->previous)
+    sz += sizeCIBlock(b->size);
   if (L->stack.p != NULL)
     sz += cast_uint(stacksize(L) + EXTRA_STACK) * sizeof(StackValue);
   return sz;
@@ -288,10 +324,13 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   setthvalue2s(L, L->top.p, L1);
   api_incr_top(L);
   preinit_thread(L1, g);
-  L1->hookmask = L->hookmask;
+  L1->hookmask = L->hookmask & ~(MASKSAMPLE | MASKBUDGET);
   L1->basehookcount = L->basehookcount;
   L1->hook = L->hook;
   resethookcount(L1);
+  L1->basebudget = L->basebudget;  /* new thread inherits the budget */
+  L1->budgethook = L->budgethook;
+  resetbudget(L1);
   /* initialize L1 extra space */
   memcpy(lua_getextraspace(L1), lua_getextraspace(mainthread(g)),
          LUA_EXTRASPACE);
@@ -356,6 +395,11 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->ud = ud;
   g->warnf = NULL;
   g->ud_warn = NULL;
+  g->sampler = NULL;
+  g->running = L;
+#if defined(LUAI_OPSTATS)
+  memset(&g->opstats, 0, sizeof(g->opstats));
+#endif
   g->seed = seed;
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
@@ -366,6 +410,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->gckind = KGC_INC;
   g->gcstopem = 0;
   g->gcemergency = 0;
+  g->gcremarked = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
   g->finobj = g->tobefnz = g->fixedgc = NULL;
   g->firstold1 = g->survival = g->old1 = g->reallyold = NULL;
   g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
@@ -380,6 +426,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   setgcparam(g, PAUSE, LUAI_GCPAUSE);
   setgcparam(g, STEPMUL, LUAI_GCMUL);
   setgcparam(g, STEPSIZE, LUAI_GCSTEPSIZE);
+  setgcparam(g, STEPTIME, LUAI_GCSTEPTIME);
   setgcparam(g, MINORMUL, LUAI_GENMINORMUL);
   setgcparam(g, MINORMAJOR, LUAI_MINORMAJOR);
   setgcparam(g, MAJORMINOR, LUAI_MAJORMINOR);
@@ -412,9 +459,12 @@ void luaE_warning (lua_State *L, const char *msg, int tocont) {
 */
 void luaE_warnerror (lua_State *L, const char *where) {
   TValue *errobj = s2v(L->top.p - 1);  /* error object */
-  const char *msg = (ttisstring(errobj))
-                  ? getstr(tsvalue(errobj))
-                  : "error object is not a string";
+  const char *msg;
+  if (ttisstring(errobj))  /* 'msg' needs a final '\0' that stays there */
+    luaS_fixcstr(L, tsvalue(errobj));  /* ('warnf' may create strings) */
+  msg = (ttisstring(errobj))
+      ? getstr(tsvalue(errobj))
+      : "error object is not a string";
   /* produce warning "error in %s (%s)" (where, msg) */
   luaE_warning(L, "error in ", 1);
   luaE_warning(L, where, 1);
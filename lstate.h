@@ -209,6 +209,25 @@ struct CallInfo {
 };
 
 
+/*
+** CallInfo structures are allocated in blocks of contiguous entries,
+** so that consecutive frames share cache lines. Entries in a block are
+** linked in order through 'previous'/'next', and each new block is
+** linked after the last entry of the previous one, so that the whole
+** 'ci' list of a thread always ends at the last entry of its last
+** block. Blocks are never moved, so pointers to CallInfos are stable.
+*/
+typedef struct CIBlock {
+  struct CIBlock *previous;  /* previous block */
+  int size;  /* number of entries in 'ci' */
+  CallInfo ci[1];  /* entries */
+} CIBlock;
+
+/* size of a CIBlock with 'n' entries */
+#define sizeCIBlock(n)  \
+	(offsetof(CIBlock, ci) + cast_sizet(n) * sizeof(CallInfo))
+
+
 /*
 ** Maximum expected number of results from a function
 ** (must fit in CIST_NRESULTS).
@@ -285,6 +304,7 @@ struct CallInfo {
 struct lua_State {
   CommonHeader;
   lu_byte allowhook;
+  lu_byte mmstack;  /* true if stack is in a reserved region */
   TStatus status;
   StkIdRel top;  /* first free slot in the stack */
   struct global_State *l_G;
@@ -297,13 +317,17 @@ struct lua_State {
   struct lua_State *twups;  /* list of threads with open upvalues */
   struct lua_longjmp *errorJmp;  /* current error recover point */
   CallInfo base_ci;  /* CallInfo for first level (C host) */
+  CIBlock *ciblock;  /* last block of CallInfos */
   volatile lua_Hook hook;
   ptrdiff_t errfunc;  /* current error handling function (stack index) */
   l_uint32 nCcalls;  /* number of nested non-yieldable or C calls */
   int oldpc;  /* last pc traced */
-  int nci;  /* number of items in 'ci' list */
+  int nci;  /* number of items in 'ci' list (excluding 'base_ci') */
   int basehookcount;
   int hookcount;
+  int basebudget;  /* budget of the thread (0 if none) */
+  int budget;  /* remaining budget (see 'lua_setbudget') */
+  lua_Hook budgethook;  /* to be called when the budget runs out */
   volatile l_signalT hookmask;
   struct {  /* info about transferred values (for call/return hooks) */
     int ftransfer;  /* offset of first value transferred */
@@ -321,6 +345,44 @@ typedef struct LX {
 } LX;
 
 
+/*
+** Execution statistics for opcodes, kept only when Lua is built with
+** LUAI_OPSTATS. 'pair[a][b]' counts how many times opcode 'b' was
+** executed right after opcode 'a'; 'cycles[o]' accumulates the clock
+** ticks (as measured by 'luai_opclock') spent executing opcode 'o'
+** (only when Lua is also built with LUAI_OPCYCLES).
+*/
+#if defined(LUAI_OPSTATS)
+
+#include "lopcodes.h"
+
+typedef struct OpStats {
+  lua_Unsigned count[NUM_OPCODES];
+  lua_Unsigned pair[NUM_OPCODES][NUM_OPCODES];
+  lua_Unsigned cycles[NUM_OPCODES];
+  lua_Unsigned last;  /* clock when last instruction started */
+  int prev;  /* last opcode executed */
+} OpStats;
+
+#endif
+
+
+/*
+** Garbage-collection statistics, indexed by the LUA_GCS* constants.
+** 'cur' accumulates the collection in progress; when it finishes, it
+** is moved to 'last' and added to 'total'. Times are in microseconds,
+** as measured by 'luai_gcclock'.
+*/
+typedef struct GCStats {
+  lua_Integer cur[LUA_GCSN];
+  lua_Integer last[LUA_GCSN];
+  lua_Integer total[LUA_GCSN];
+  lua_Integer tstep;  /* clock when current step started */
+  lua_Integer tphase;  /* clock when current phase (in this step) started */
+  lu_byte done;  /* kind of collection finished in this step, if any */
+} GCStats;
+
+
 /*
 ** 'global state', shared by all threads of this state
 */
@@ -342,6 +404,7 @@ typedef struct global_State {
   lu_byte gcstopem;  /* stops emergency collections */
   lu_byte gcstp;  /* control whether GC is running */
   lu_byte gcemergency;  /* true if this is an emergency collection */
+  lu_byte gcremarked;  /* true if 'grayagain' was already remarked */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -367,7 +430,13 @@ typedef struct global_State {
   struct Table *mt[LUA_NUMTYPES];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
+  lua_Hook sampler;  /* function to be called by a requested sample */
+  struct lua_State *volatile running;  /* thread running Lua code */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  GCStats gcstats;  /* garbage-collection statistics */
+#if defined(LUAI_OPSTATS)
+  OpStats opstats;  /* execution statistics for opcodes */
+#endif
   LX mainth;  /* main thread of this state */
 } global_State;
 
@@ -440,6 +509,7 @@ LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 LUAI_FUNC lu_mem luaE_threadsize (lua_State *L);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L, int err);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
+LUAI_FUNC void luaE_freelastCIblock (lua_State *L);
 LUAI_FUNC void luaE_checkcstack (lua_State *L);
 LUAI_FUNC void luaE_incCstack (lua_State *L);
 LUAI_FUNC void luaE_warning (lua_State *L, const char *msg, int tocont);
@@ -154,8 +154,8 @@ size_t luaS_sizelngstr (size_t len, int kind) {
     case LSTRFIX:  /* fixed external long string */
       /* don't need 'falloc'/'ud' */
       return offsetof(TString, falloc);
-    default:  /* external long string with deallocation */
-      lua_assert(kind == LSTRMEM);
+    default:  /* external string with deallocation or in a buffer */
+      lua_assert(kind == LSTRMEM || kind == LSTRBUF);
       return sizeof(TString);
   }
 }
@@ -351,3 +351,101 @@ TString *luaS_normstr (lua_State *L, TString *ts) {
   }
 }
 
+
+
+/*
+** {==================================================================
+** Concatenation buffers
+** ===================================================================
+*/
+
+/*
+** Allocate a buffer with space for 'size' characters, initially used
+** by no strings.
+*/
+static StrBuff *newbuff (lua_State *L, size_t size) {
+  StrBuff *b = cast(StrBuff *, luaM_newblock(L, sizestrbuff(size)));
+  b->size = size;
+  b->used = 0;
+  b->nrefs = 0;
+  b->frozen = 0;
+  return b;
+}
+
+
+void luaS_freebuff (lua_State *L, StrBuff *b) {
+  lua_assert(b->nrefs > 0);
+  if (--b->nrefs == 0)  /* no more strings using it? */
+    luaM_freemem(L, b, sizestrbuff(b->size));
+}
+
+
+/*
+** Create a long string with length 'l' for the concatenation of long
+** string 'ts' with other strings. The result comes with the contents
+** of 'ts' and a final '\0'; the caller must fill in the other
+** 'l - len(ts)' characters. When 'ts' is the longest string in a
+** buffer with enough free space, the result shares that buffer, so
+** that the contents of 'ts' are not copied. Otherwise, the result gets
+** a new buffer with some free space, so that the next concatenations
+** to it can do the same. This makes loops like 's = s .. x' linear
+** instead of quadratic.
+*/
+TString *luaS_concatlngstr (lua_State *L, TString *ts, size_t l) {
+  size_t tl = ts->u.lnglen;
+  StrBuff *b;
+  TString *res;
+  lua_assert(!strisshr(ts) && tl <= l);
+  if (ts->shrlen == LSTRBUF && !(b = getstrbuff(ts))->frozen &&
+      tl == b->used && l - tl <= b->size - tl)  /* can grow in place? */
+    res = createstrobj(L, sizeof(TString), LUA_VLNGSTR, G(L)->seed);
+  else {
+    struct NewExt ne;
+    size_t size = (l < (MAX_SIZE - sizeof(StrBuff)) / 2) ? l + l / 2 : l;
+    b = newbuff(L, size);
+    ne.kind = LSTRBUF;
+    if (luaD_rawrunprotected(L, f_newext, &ne) != LUA_OK) {  /* mem. error? */
+      luaM_freemem(L, b, sizestrbuff(size));
+      luaM_error(L);  /* re-raise memory error */
+    }
+    res = ne.ts;
+    memcpy(buffcontents(b), getlngstr(ts), tl * sizeof(char));
+  }
+  b->nrefs++;
+  b->used = l;
+  buffcontents(b)[l] = '\0';  /* ending 0 */
+  res->shrlen = LSTRBUF;
+  res->u.lnglen = l;
+  res->contents = buffcontents(b);
+  res->falloc = NULL;
+  res->ud = b;
+  return res;
+}
+
+
+/*
+** Make sure that string 'ts' in a buffer is followed by a '\0' that
+** no later concatenation will overwrite: If it is the longest string
+** in the buffer, or the only one, the buffer stops growing at its end;
+** otherwise, the string gets a copy of its contents in a buffer of its
+** own.
+*/
+void luaS_fixbuff (lua_State *L, TString *ts) {
+  StrBuff *b = getstrbuff(ts);
+  size_t l = ts->u.lnglen;
+  if (l != b->used && b->nrefs > 1) {  /* other strings use what follows? */
+    StrBuff *nb = newbuff(L, l);
+    memcpy(buffcontents(nb), getlngstr(ts), l * sizeof(char));
+    nb->nrefs = 1;
+    luaS_freebuff(L, b);
+    b = nb;
+    ts->contents = buffcontents(b);
+    ts->ud = b;
+  }
+  b->used = l;
+  buffcontents(b)[l] = '\0';
+  b->frozen = 1;
+}
+
+/* }================================================================== */
+
@@ -54,6 +54,54 @@
 #define eqshrstr(a,b)	check_exp((a)->tt == LUA_VSHRSTR, (a) == (b))
 
 
+/*
+** Buffer shared by long strings created by repeated concatenations
+** (strings of kind LSTRBUF, which keep the buffer in their field 'ud').
+** Each of these strings is a prefix of the buffer contents; only the
+** ones as long as its used part are sure to be followed by a '\0'.
+*/
+typedef struct StrBuff {
+  size_t size;  /* number of characters that fit in the buffer */
+  size_t used;  /* number of characters in use */
+  size_t nrefs;  /* number of strings using the buffer */
+  lu_byte frozen;  /* true if the buffer cannot grow anymore */
+} StrBuff;
+
+#define getstrbuff(ts)	\
+	check_exp((ts)->shrlen == LSTRBUF, cast(StrBuff *, (ts)->ud))
+
+/* contents of a buffer */
+#define buffcontents(b)	(cast_charp(b) + sizeof(StrBuff))
+
+/* size of a buffer with space for 'n' characters (plus the final '\0') */
+#define sizestrbuff(n)	(sizeof(StrBuff) + ((n) + 1) * sizeof(char))
+
+
+/*
+** Make sure that the contents of string 'ts' can be handed out as a C
+** string: It must be followed by a '\0' that no later concatenation
+** will overwrite.
+*/
+#define luaS_fixcstr(L,ts)  \
+	((ts)->shrlen == LSTRBUF ? luaS_fixbuff(L, ts) : cast_void(0))
+
+/*
+** Code that needs the final '\0' of string 'ts' only for a moment,
+** without running Lua code or creating strings meanwhile, can put
+** it there with 'luaS_setend' (which saves the replaced character in
+** 'c') and then restore that character with 'luaS_resetend'.
+*/
+#define luaS_setend(ts,c)  \
+	((ts)->shrlen == LSTRBUF \
+	? cast_void(((c) = (ts)->contents[(ts)->u.lnglen], \
+	             (ts)->contents[(ts)->u.lnglen] = '\0')) \
+	: cast_void(0))
+
+#define luaS_resetend(ts,c)  \
+	((ts)->shrlen == LSTRBUF \
+	? cast_void((ts)->contents[(ts)->u.lnglen] = (c)) : cast_void(0))
+
+
 LUAI_FUNC unsigned luaS_hashlongstr (TString *ts);
 LUAI_FUNC int luaS_eqstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
@@ -69,5 +117,8 @@ LUAI_FUNC TString *luaS_newextlstr (lua_State *L,
 		const char *s, size_t len, lua_Alloc falloc, void *ud);
 LUAI_FUNC size_t luaS_sizelngstr (size_t len, int kind);
 LUAI_FUNC TString *luaS_normstr (lua_State *L, TString *ts);
+LUAI_FUNC TString *luaS_concatlngstr (lua_State *L, TString *ts, size_t l);
+LUAI_FUNC void luaS_fixbuff (lua_State *L, TString *ts);
+LUAI_FUNC void luaS_freebuff (lua_State *L, StrBuff *b);
 
 #endif
@@ -747,6 +747,31 @@ void luaH_resize (lua_State *L, Table *t, unsigned newasize,
 }
 
 
+/*
+** Remove all entries from table 't' and give its parts the sizes
+** 'asize' and 'hsize', resizing them only if needed.
+*/
+void luaH_clear (lua_State *L, Table *t, unsigned asize, unsigned hsize) {
+  clearNewSlice(t, 0, t->asize);
+  if (t->array != NULL)
+    *lenhint(t) = t->asize / 2u;
+  if (!isdummy(t)) {
+    unsigned size = sizenode(t);
+    unsigned i;
+    for (i = 0; i < size; i++) {
+      Node *n = gnode(t, i);
+      gnext(n) = 0;
+      setnilkey(n);
+      setempty(gval(n));
+    }
+    if (haslastfree(t))
+      getlastfree(t) = gnode(t, size);  /* all positions are free */
+  }
+  if (t->asize != asize || allocsizenode(t) != hsize)
+    luaH_resize(L, t, asize, hsize);  /* (table is empty now) */
+}
+
+
 void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
   unsigned nsize = allocsizenode(t);
   luaH_resize(L, t, nasize, nsize);
@@ -36,6 +36,17 @@
 #define setdummy(t)		((t)->flags |= BITDUMMY)
 
 
+/*
+** Bit BITPRIVATE set in 'flags' means the table is private: it was
+** created by OP_NEWTABLEP and it is referred only by the register
+** where that instruction put it.
+*/
+#define BITPRIVATE		(1 << 7)
+#define isprivate(t)		((t)->flags & BITPRIVATE)
+#define setprivate(t)		((t)->flags |= BITPRIVATE)
+#define setnoprivate(t)		((t)->flags &= cast_byte(~BITPRIVATE))
+
+
 
 /* allocated size for hash nodes */
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
@@ -170,6 +181,8 @@ LUAI_FUNC Table *luaH_new (lua_State *L);
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned nasize,
                                                     unsigned nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned nasize);
+LUAI_FUNC void luaH_clear (lua_State *L, Table *t, unsigned asize,
+                                                  unsigned hsize);
 LUAI_FUNC lu_mem luaH_size (Table *t);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
@@ -44,6 +44,10 @@
 void *l_Trick = 0;
 
 
+/* hits and misses of inline caches in field accesses */
+unsigned long l_icstats[2] = {0UL, 0UL};
+
+
 #define obj_at(L,k)	s2v(L->ci->func.p + (k))
 
 
@@ -433,6 +437,7 @@ static void checkproto (global_State *g, Proto *f) {
   int i;
   GCObject *fgc = obj2gco(f);
   checkobjrefN(g, fgc, f->source);
+  checkobjrefN(g, fgc, f->cache);
   for (i=0; i<f->sizek; i++) {
     if (iscollectable(f->k + i))
       checkobjref(g, fgc, gcvalue(f->k + i));
@@ -962,6 +967,18 @@ static int alloc_failnext (lua_State *L) {
 }
 
 
+/*
+** Return the number of hits and misses of the inline caches since
+** last call (see 'luaV_execute'), and reset them.
+*/
+static int ic_stats (lua_State *L) {
+  lua_pushinteger(L, cast(lua_Integer, l_icstats[0]));
+  lua_pushinteger(L, cast(lua_Integer, l_icstats[1]));
+  l_icstats[0] = l_icstats[1] = 0;
+  return 2;
+}
+
+
 static int settrick (lua_State *L) {
   if (ttisnil(obj_at(L, 1)))
     l_Trick = NULL;
@@ -1102,18 +1119,18 @@ static int stacklevel (lua_State *L) {
   lua_pushinteger(L, cast_Integer(L->nCcalls));
   lua_pushinteger(L, L->nci);
   lua_pushinteger(L, (lua_Integer)(size_t)&a);
-  return 5;
+  lua_pushboolean(L, L->mmstack);
+  return 6;
 }
 
 
 static int resetCI (lua_State *L) {
-  CallInfo *ci = L->ci;
-  while (ci->next != NULL) {
-    CallInfo *tofree = ci->next;
-    ci->next = ci->next->next;
-    luaM_free(L, tofree);
-    L->nci--;
-  }
+  CIBlock *b;
+  /* free all blocks after the one with the current CallInfo */
+  while ((b = L->ciblock) != NULL &&
+         !(b->ci <= L->ci && L->ci < b->ci + b->size))
+    luaE_freelastCIblock(L);
+  L->ci->next = NULL;  /* hide remaining entries of current block */
   return 0;
 }
 
@@ -1401,6 +1418,101 @@ static int doremote (lua_State *L) {
 }
 
 
+/*
+** Fills 'n' bytes of block 'b' with a pattern based on 'seed'
+** ('check' true) or checks that they still have it ('check' false).
+*/
+static int poolpattern (void *b, size_t n, size_t seed, int check) {
+  unsigned char *p = cast(unsigned char *, b);
+  size_t i;
+  for (i = 0; i < n; i++) {
+    unsigned char v = cast(unsigned char, seed + i * 7);
+    if (!check)
+      p[i] = v;
+    else if (p[i] != v)
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Reallocates a block through a sequence of sizes, crossing between
+** size classes and large blocks, checking that its contents survive
+** each move.
+*/
+static int poolreallocs (luaL_Pool *pool, size_t seed) {
+  static const size_t sizes[] = {10, 16, 17, 40, 256, 257, 1000, 3000,
+                                 300, 250, 100, 33, 1};
+  size_t osize = 0;
+  size_t i;
+  void *b = NULL;
+  void *old;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t nsize = sizes[i];
+    b = luaL_poolalloc(pool, b, osize, nsize);
+    if (b == NULL ||
+        !poolpattern(b, (osize < nsize) ? osize : nsize, seed, 1))
+      return 0;
+    poolpattern(b, nsize, seed, 0);
+    osize = nsize;
+  }
+  /* a block freed to a size class is reused by that class */
+  old = b;
+  luaL_poolalloc(pool, b, osize, 0);
+  b = luaL_poolalloc(pool, NULL, LUA_TSTRING, osize + 2);
+  luaL_poolalloc(pool, b, osize + 2, 0);
+  return (b == old);
+}
+
+
+/*
+** Runs a chunk in a new state backed by a new pool (after exercising
+** the pool directly), then closes the state and the pool. Returns
+** the results of the chunk as strings or, on errors, false plus the
+** error message.
+*/
+static int dopool (lua_State *L) {
+  size_t lcode;
+  const char *code = luaL_checklstring(L, 1, &lcode);
+  luaL_Pool *pool = luaL_newpool();
+  lua_State *L1;
+  int status, i;
+  if (pool == NULL)
+    return luaL_error(L, "cannot create pool");
+  for (i = 0; i < 10; i++) {
+    if (!poolreallocs(pool, cast_sizet(i))) {
+      luaL_closepool(pool);
+      return luaL_error(L, "pool corrupted block");
+    }
+  }
+  L1 = lua_newstate(luaL_poolalloc, pool, 0);
+  if (L1 == NULL) {
+    luaL_closepool(pool);
+    return luaL_error(L, "cannot create state");
+  }
+  lua_atpanic(L1, tpanic);
+  luaL_openlibs(L1);
+  status = luaL_loadbuffer(L1, code, lcode, code);
+  if (status == LUA_OK)
+    status = lua_pcall(L1, 0, LUA_MULTRET, 0);
+  lua_settop(L, 0);
+  if (status != LUA_OK) {
+    lua_pushboolean(L, 0);
+    lua_pushstring(L, lua_tostring(L1, -1));
+  }
+  else {
+    int n = lua_gettop(L1);
+    luaL_checkstack(L, n, "too many results");
+    for (i = 1; i <= n; i++)
+      lua_pushstring(L, lua_tostring(L1, i));
+  }
+  lua_close(L1);
+  luaL_closepool(pool);
+  return lua_gettop(L);
+}
+
+
 static int log2_aux (lua_State *L) {
   unsigned int x = (unsigned int)luaL_checkinteger(L, 1);
   lua_pushinteger(L, luaO_ceillog2(x));
@@ -2170,6 +2282,7 @@ static const struct luaL_Reg tests_funcs[] = {
   {"closestate", closestate},
   {"d2s", d2s},
   {"doonnewstack", doonnewstack},
+  {"dopool", dopool},
   {"doremote", doremote},
   {"gccolor", gc_color},
   {"gcage", gc_age},
@@ -2178,6 +2291,7 @@ static const struct luaL_Reg tests_funcs[] = {
   {"pobj", gc_printobj},
   {"getref", getref},
   {"hash", hash_query},
+  {"icstats", ic_stats},
   {"log2", log2_aux},
   {"limits", get_limits},
   {"listcode", listcode},
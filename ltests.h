@@ -67,6 +67,11 @@ LUA_API Memcontrol l_memcontrol;
 extern void luai_tracegctest (lua_State *L, int first);
 
 
+/* count hits and misses of inline caches */
+#define luai_icstat(L,hit)	((void)L, l_icstats[(hit) ? 0 : 1]++)
+extern unsigned long l_icstats[2];
+
+
 /*
 ** generic variable for debug tricks
 */
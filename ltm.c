@@ -93,8 +93,10 @@ const char *luaT_objtypename (lua_State *L, const TValue *o) {
   if ((ttistable(o) && (mt = hvalue(o)->metatable) != NULL) ||
       (ttisfulluserdata(o) && (mt = uvalue(o)->metatable) != NULL)) {
     const TValue *name = luaH_Hgetshortstr(mt, luaS_new(L, "__name"));
-    if (ttisstring(name))  /* is '__name' a string? */
+    if (ttisstring(name)) {  /* is '__name' a string? */
+      luaS_fixcstr(L, tsvalue(name));
       return getstr(tsvalue(name));  /* use it as type name */
+    }
   }
   return ttypename(ttype(o));  /* else use standard type name */
 }
@@ -246,34 +248,11 @@ static void createvarargtab (lua_State *L, StkId f, int n) {
 }
 
 
-/*
-** initial stack:  func arg1 ... argn extra1 ...
-**                 ^ ci->func                    ^ L->top
-** final stack: func nil ... nil extra1 ... func arg1 ... argn
-**                                          ^ ci->func
-*/
-static void buildhiddenargs (lua_State *L, CallInfo *ci, const Proto *p,
-                             int totalargs, int nfixparams, int nextra) {
-  int i;
-  ci->u.l.nextraargs = nextra;
-  luaD_checkstack(L, p->maxstacksize + 1);
-  /* copy function to the top of the stack, after extra arguments */
-  setobjs2s(L, L->top.p++, ci->func.p);
-  /* move fixed parameters to after the copied function */
-  for (i = 1; i <= nfixparams; i++) {
-    setobjs2s(L, L->top.p++, ci->func.p + i);
-    setnilvalue(s2v(ci->func.p + i));  /* erase original parameter (for GC) */
-  }
-  ci->func.p += totalargs + 1;  /* 'func' now lives after hidden arguments */
-  ci->top.p += totalargs + 1;
-}
-
-
 void luaT_adjustvarargs (lua_State *L, CallInfo *ci, const Proto *p) {
-  int totalargs = cast_int(L->top.p - ci->func.p) - 1;
-  int nfixparams = p->numparams;
-  int nextra = totalargs - nfixparams;  /* number of extra arguments */
   if (p->flag & PF_VATAB) {  /* does it need a vararg table? */
+    int totalargs = cast_int(L->top.p - ci->func.p) - 1;
+    int nfixparams = p->numparams;
+    int nextra = totalargs - nfixparams;  /* number of extra arguments */
     lua_assert(!(p->flag & PF_VAHID));
     createvarargtab(L, ci->func.p + nfixparams + 1, nextra);
     /* move table to proper place (last parameter) */
@@ -281,9 +260,8 @@ void luaT_adjustvarargs (lua_State *L, CallInfo *ci, const Proto *p) {
   }
   else {  /* no table */
     lua_assert(p->flag & PF_VAHID);
-    buildhiddenargs(L, ci, p, totalargs, nfixparams, nextra);
-    /* set vararg parameter to nil */
-    setnilvalue(s2v(ci->func.p + nfixparams + 1));
+    luaD_checkstack(L, p->maxstacksize + 1);
+    luaT_buildhiddenargs(L, ci, p);
     lua_assert(L->top.p <= ci->top.p && ci->top.p <= L->stack_last.p);
   }
 }
@@ -339,26 +317,24 @@ void luaT_getvarargs (lua_State *L, CallInfo *ci, StkId where, int wanted,
                                     int vatab) {
   Table *h = (vatab < 0) ? NULL : hvalue(s2v(ci->func.p + vatab + 1));
   int nargs = getnumargs(L, ci, h);  /* number of available vararg args. */
-  int i, touse;  /* 'touse' is minimum between 'wanted' and 'nargs' */
   if (wanted < 0) {
-    touse = wanted = nargs;  /* get all extra arguments available */
+    wanted = nargs;  /* get all extra arguments available */
     checkstackp(L, nargs, where);  /* ensure stack space */
     L->top.p = where + nargs;  /* next instruction will need top */
   }
-  else
-    touse = (nargs > wanted) ? wanted : nargs;
   if (h == NULL) {  /* no vararg table? */
-    for (i = 0; i < touse; i++)  /* get vararg values from the stack */
-      setobjs2s(L, where + i, ci->func.p - nargs + i);
+    luaT_gethiddenargs(L, ci, where, wanted);  /* get them from the stack */
   }
   else {  /* get vararg values from vararg table */
+    int i;
+    int touse = (nargs > wanted) ? wanted : nargs;
     for (i = 0; i < touse; i++) {
       lu_byte tag = luaH_getint(h, i + 1, s2v(where + i));
       if (tagisempty(tag))
        setnilvalue(s2v(where + i));
     }
+    for (; i < wanted; i++)   /* complete required results with nil */
+      setnilvalue(s2v(where + i));
   }
-  for (; i < wanted; i++)   /* complete required results with nil */
-    setnilvalue(s2v(where + i));
 }
 
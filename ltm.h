@@ -72,6 +72,33 @@ typedef enum {
 LUAI_DDEC(const char *const luaT_typenames_[LUA_TOTALTYPES];)
 
 
+/*
+** Macros for vararg frames with hidden arguments. They are shared by
+** 'ltm.c' and the fast paths in 'luaV_execute'. (They are macros, not
+** inline functions, because 'CallInfo' is defined in 'lstate.h', which
+** includes this file.)
+*/
+
+/*
+** Build the frame of a vararg function 'p' with hidden arguments and
+** set its vararg parameter to nil. The caller must ensure space in the
+** stack for 'p->maxstacksize + 1' more slots.
+** initial stack:  func arg1 ... argn extra1 ...
+**                 ^ ci->func                    ^ L->top
+** final stack: func nil ... nil extra1 ... func arg1 ... argn
+**                                          ^ ci->func
+*/
+#define luaT_buildhiddenargs(L,ci,p)    { StkId f_ = (ci)->func.p;     int totalargs_ = cast_int((L)->top.p - f_) - 1;     int i_;     (ci)->u.l.nextraargs = totalargs_ - (p)->numparams;     /* copy function to the top of the stack, after extra arguments */     setobjs2s(L, (L)->top.p++, f_);     /* move fixed parameters to after the copied function */     for (i_ = 1; i_ <= (p)->numparams; i_++) {       setobjs2s(L, (L)->top.p++, f_ + i_);       setnilvalue(s2v(f_ + i_));  /* erase original parameter (for GC) */     }     (ci)->func.p += totalargs_ + 1;  /* 'func' now after hidden args. */     (ci)->top.p += totalargs_ + 1;     setnilvalue(s2v((ci)->func.p + (p)->numparams + 1)); }
+
+
+/*
+** Copy 'wanted' hidden arguments of frame 'ci' to 'where', completing
+** with nils if there are not enough of them.
+*/
+#define luaT_gethiddenargs(L,ci,where,wanted)    { int n_ = (ci)->u.l.nextraargs;     StkId va_ = (ci)->func.p - n_;  /* first extra argument */     int i_;     for (i_ = 0; i_ < (wanted) && i_ < n_; i_++)       setobjs2s(L, (where) + i_, va_ + i_);     for (; i_ < (wanted); i_++)       setnilvalue(s2v((where) + i_)); }
+
+
+
 LUAI_FUNC const char *luaT_objtypename (lua_State *L, const TValue *o);
 
 LUAI_FUNC const TValue *luaT_gettm (Table *events, TMS event, TString *ename);
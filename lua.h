@@ -338,6 +338,7 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 #define LUA_GCGEN		7
 #define LUA_GCINC		8
 #define LUA_GCPARAM		9
+#define LUA_GCSTATS		10
 
 
 /*
@@ -352,9 +353,31 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 #define LUA_GCPPAUSE		3  /* size of pause between successive GCs */
 #define LUA_GCPSTEPMUL		4  /* GC "speed" */
 #define LUA_GCPSTEPSIZE		5  /* GC granularity */
+#define LUA_GCPSTEPTIME		6  /* time budget for a GC step */
 
 /* number of parameters */
-#define LUA_GCPN		6
+#define LUA_GCPN		7
+
+
+/*
+** garbage-collection statistics (option LUA_GCSTATS)
+*/
+/* time spent in each phase, in microseconds */
+#define LUA_GCSPROPAGATE	0  /* marking */
+#define LUA_GCSATOMIC		1  /* atomic phase */
+#define LUA_GCSSWEEP		2  /* sweeping */
+#define LUA_GCSCALLFIN		3  /* calling finalizers */
+#define LUA_GCSMAXSTEP		4  /* longest single step */
+
+/* work done */
+#define LUA_GCSMARKED		5  /* bytes marked */
+#define LUA_GCSSWEPT		6  /* objects swept */
+#define LUA_GCSFREED		7  /* objects freed */
+#define LUA_GCSMAJOR		8  /* major collections */
+#define LUA_GCSMINOR		9  /* minor collections */
+
+/* number of statistics */
+#define LUA_GCSN		10
 
 
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
@@ -456,6 +479,8 @@ LUA_API void (lua_closeslot) (lua_State *L, int idx);
 #define LUA_HOOKLINE	2
 #define LUA_HOOKCOUNT	3
 #define LUA_HOOKTAILCALL 4
+#define LUA_HOOKSAMPLE	5
+#define LUA_HOOKBUDGET	6
 
 
 /*
@@ -482,6 +507,11 @@ LUA_API void (lua_sethook) (lua_State *L, lua_Hook func, int mask, int count);
 LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
 LUA_API int (lua_gethookcount) (lua_State *L);
+LUA_API void (lua_sample) (lua_State *L, lua_Hook f);
+LUA_API void (lua_setbudget) (lua_State *L, int budget, lua_Hook f);
+LUA_API const char *(lua_getopstat) (lua_State *L, int op, int prev,
+                                     lua_Unsigned *count,
+                                     lua_Unsigned *cycles);
 
 
 struct lua_Debug {
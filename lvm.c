@@ -46,6 +46,16 @@
 
 
 
+/*
+** By default, the interpreter quickens generic opcodes into versions
+** specialized for the types of their operands. (See 'Quickening'.)
+*/
+#if !defined(LUA_USE_QUICKENING)
+#define LUA_USE_QUICKENING	1
+#endif
+
+
+
 /* limit for table tag-method chains (to avoid infinite loops) */
 #define MAXTAGLOOP	2000
 
@@ -96,7 +106,12 @@ static int l_strton (const TValue *obj, TValue *result) {
     TString *st = tsvalue(obj);
     size_t stlen;
     const char *s = getlstr(st, stlen);
-    return (luaO_str2num(s, result) == stlen + 1);
+    char c = '\0';
+    int res;
+    luaS_setend(st, c);  /* 'luaO_str2num' needs the final '\0' */
+    res = (luaO_str2num(s, result) == stlen + 1);
+    luaS_resetend(st, c);
+    return res;
   }
 }
 
@@ -388,7 +403,7 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
 ** of the strings. Note that segments can compare equal but still
 ** have different lengths.
 */
-static int l_strcmp (const TString *ts1, const TString *ts2) {
+static int strcmpaux (const TString *ts1, const TString *ts2) {
   size_t rl1;  /* real length */
   const char *s1 = getlstr(ts1, rl1);
   size_t rl2;
@@ -412,6 +427,25 @@ static int l_strcmp (const TString *ts1, const TString *ts2) {
 }
 
 
+/*
+** Strings in buffers may lack their final '\0' (see 'luaS_setend').
+** When both are in the same buffer, one is a prefix of the other, so
+** the '\0' after the shorter one does not change the result for the
+** longer one: it works like an embedded '\0' after which the shorter
+** string is finished.
+*/
+static int l_strcmp (const TString *ts1, const TString *ts2) {
+  char c1 = '\0', c2 = '\0';  /* characters replaced by the '\0's */
+  int res;
+  luaS_setend(ts1, c1);
+  luaS_setend(ts2, c2);
+  res = strcmpaux(ts1, ts2);
+  luaS_resetend(ts2, c2);  /* restore in reverse order */
+  luaS_resetend(ts1, c1);
+  return res;
+}
+
+
 /*
 ** Check whether integer 'i' is less than float 'f'. If 'i' has an
 ** exact representation as a float ('l_intfitsf'), compare numbers as
@@ -713,6 +747,11 @@ void luaV_concat (lua_State *L, int total) {
         copy2buff(top, n, buff);  /* copy strings to buffer */
         ts = luaS_newlstr(L, buff, tl);
       }
+      else if (ttislngstring(s2v(top - n))) {  /* appending to long string? */
+        TString *ts1 = tsvalue(s2v(top - n));
+        ts = luaS_concatlngstr(L, ts1, tl);  /* comes with 'ts1' contents */
+        copy2buff(top, n - 1, getlngstr(ts) + tsslen(ts1));
+      }
       else {  /* long string; copy strings directly to final result */
         ts = luaS_createlngstrobj(L, tl);
         copy2buff(top, n, getlngstr(ts));
@@ -827,9 +866,69 @@ lua_Integer luaV_shiftl (lua_Integer x, lua_Integer y) {
 }
 
 
+/*
+** Get into 'b' and 'c' the hash and array sizes of the table created
+** by OP_NEWTABLE (or OP_NEWTABLEP) 'i'; 'extra' is its extra argument.
+*/
+static void tablesizes (Instruction i, Instruction extra,
+                        unsigned *b, unsigned *c) {
+  *b = cast_uint(GETARG_vB(i));  /* log2(hash size) + 1 */
+  *c = cast_uint(GETARG_vC(i));  /* array size */
+  if (*b > 0)
+    *b = 1u << (*b - 1);  /* hash size is 2^(b - 1) */
+  if (TESTARG_k(i)) {  /* non-zero extra argument? */
+    lua_assert(GETARG_Ax(extra) != 0);
+    /* add it to array size */
+    *c += cast_uint(GETARG_Ax(extra)) * (MAXARG_vC + 1);
+  }
+}
+
+
+/*
+** Create the table for OP_NEWTABLE (or OP_NEWTABLEP) 'i' into 'ra';
+** 'extra' is its extra argument.
+*/
+static Table *newtable (lua_State *L, StkId ra, Instruction i,
+                        Instruction extra) {
+  unsigned b, c;
+  Table *t;
+  tablesizes(i, extra, &b, &c);
+  L->top.p = ra + 1;  /* correct top in case of emergency GC */
+  t = luaH_new(L);  /* memory allocation */
+  sethvalue2s(L, ra, t);
+  if (b != 0 || c != 0)
+    luaH_resize(L, t, c, b);  /* idem */
+  return t;
+}
+
+
+/*
+** check whether cached closure in prototype 'p' may be reused, that is,
+** whether there is a cached closure with the same upvalues needed by
+** new closure to be created.
+*/
+static LClosure *getcached (Proto *p, UpVal **encup, StkId base) {
+  LClosure *c = p->cache;
+  if (c != NULL) {  /* is there a cached closure? */
+    int nup = p->sizeupvalues;
+    Upvaldesc *uv = p->upvalues;
+    int i;
+    for (i = 0; i < nup; i++) {  /* check whether it has right upvalues */
+      if (uv[i].instack ? c->upvals[i]->v.p != s2v(base + uv[i].idx)
+                        : c->upvals[i] != encup[uv[i].idx])
+        return NULL;  /* wrong upvalue; cannot reuse closure */
+    }
+    p->cachemiss = 0;  /* got a hit */
+  }
+  return c;  /* return cached closure (or NULL if no cached closure) */
+}
+
+
 /*
 ** create a new Lua closure, push it in the stack, and initialize
-** its upvalues.
+** its upvalues. Save the new closure in the prototype's cache, unless
+** the cache missed too many times in a row; in that case, give up the
+** cache for that prototype.
 */
 static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
                          StkId ra) {
@@ -846,6 +945,13 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
       ncl->upvals[i] = encup[uv[i].idx];
     luaC_objbarrier(L, ncl, ncl->upvals[i]);
   }
+  if (p->cachemiss >= MAXMISS)  /* too many misses? */
+    p->cache = NULL;  /* give up cache */
+  else {
+    p->cache = ncl;  /* save it on cache for reuse */
+    luaC_objbarrierback(L, obj2gco(p), ncl);
+    p->cachemiss++;
+  }
 }
 
 
@@ -855,7 +961,8 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func.p + 1;
-  Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
+  /* interrupted instruction (in its generic form) */
+  Instruction inst = luaP_unquicken(*(ci->u.l.savedpc - 1));
   OpCode op = GET_OPCODE(inst);
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
@@ -914,6 +1021,113 @@ void luaV_finishOp (lua_State *L) {
 
 
 
+/*
+** {==================================================================
+** Inline caches for field accesses
+**
+** Each instruction that indexes a table with a constant short-string
+** key (OP_GETTABUP, OP_GETFIELD, OP_SELF, OP_SETTABUP, OP_SETFIELD)
+** has an entry in 'p->icache' with the index of the node where it found
+** its key the last time. An entry is only a hint: it is valid only if
+** it is inside the node array of the table and that node holds the key.
+** So, a rehash, which moves keys around (or a different table with a
+** different layout), simply makes the next access a miss, which then
+** refreshes the entry.
+** ===================================================================
+*/
+
+#if !defined(luai_icstat)
+#define luai_icstat(L,hit)	((void)L)
+#endif
+
+
+/*
+** Find the slot for short-string 'key' in table 't', using and
+** updating the cache entry 'ic'.
+*/
+l_sinline const TValue *icgetslot (lua_State *L, Table *t, TString *key,
+                                   unsigned int *ic) {
+  unsigned int idx = *ic;
+  const TValue *slot;
+  if (idx < sizenode(t)) {
+    Node *n = gnode(t, idx);
+    if (keyisshrstr(n) && eqshrstr(keystrval(n), key)) {  /* hit? */
+      luai_icstat(L, 1);
+      return gval(n);
+    }
+  }
+  luai_icstat(L, 0);
+  slot = luaH_Hgetshortstr(t, key);
+  if (!isabstkey(slot))  /* found a node with that key? */
+    *ic = cast_uint(nodefromval(slot) - t->node);  /* update cache */
+  return slot;
+}
+
+
+/*
+** Cached version of 'luaH_getshortstr'.
+*/
+l_sinline lu_byte icget (lua_State *L, Table *t, TString *key, TValue *res,
+                         unsigned int *ic) {
+  const TValue *slot = icgetslot(L, t, key, ic);
+  if (!ttisnil(slot))
+    setobj(L, res, slot);
+  return ttypetag(slot);
+}
+
+
+/*
+** Methods are usually not in the object itself, but in a "class" table
+** that is the '__index' field of the object's metatable. When the
+** object does not have the key, try that table using the same cache
+** entry. (If that fails, 'luaV_finishget' does the complete work.)
+*/
+l_sinline lu_byte icgetindex (lua_State *L, Table *t, TString *key,
+                              TValue *res, unsigned int *ic) {
+  const TValue *tm = fasttm(L, t->metatable, TM_INDEX);
+  if (tm != NULL && ttistable(tm))
+    return icget(L, hvalue(tm), key, res, ic);
+  else
+    return LUA_VABSTKEY;
+}
+
+
+/*
+** Cached version of the fast path of 'luaH_psetshortstr': when the
+** key is already present with a non-nil value, just update it.
+** Otherwise, leave the work to 'luaH_psetshortstr'.
+*/
+l_sinline int icpset (lua_State *L, Table *t, TString *key, TValue *val,
+                      unsigned int *ic) {
+  const TValue *slot = icgetslot(L, t, key, ic);
+  if (!ttisnil(slot)) {  /* key already has a value? */
+    setobj(L, cast(TValue *, slot), val);  /* update it */
+    return HOK;
+  }
+  else
+    return luaH_psetshortstr(t, key, val);
+}
+
+
+/*
+** Cache entry for the instruction being executed. (Prototypes with
+** fixed code have only one entry; see 'luaF_newicache'.)
+*/
+l_sinline unsigned int *icentry (const Proto *p, const Instruction *pc) {
+  int idx = cast_int(pc - 1 - p->code);
+  return &p->icache[(idx < p->sizeicache) ? idx : 0];
+}
+
+
+#define fastgetic(t,k,res,ic,tag) \
+  (tag = (!ttistable(t) ? LUA_VNOTABLE : icget(L, hvalue(t), k, res, ic)))
+
+#define fastsetic(t,k,val,ic,hres) \
+  (hres = (!ttistable(t) ? HNOTATABLE : icpset(L, hvalue(t), k, val, ic)))
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Macros for arithmetic/bitwise/comparison opcodes in 'luaV_execute'
@@ -1088,6 +1302,157 @@ void luaV_finishOp (lua_State *L) {
 /* }================================================================== */
 
 
+/*
+** {==================================================================
+** Quickening
+**
+** Instructions OP_ADD, OP_SUB, OP_MUL, OP_EQ, OP_LT, OP_LE, and
+** OP_GETTABLE rewrite themselves (in the prototype's code) into a
+** quickened version when they find operands with some given types:
+** two integers, two floats, or a table and an integer key. The
+** quickened version checks only for those types, avoiding the tests
+** for other cases. When that check fails, it rewrites itself back into
+** its generic version, with a mark to avoid new quickenings (so that
+** polymorphic instructions do not keep changing), and does the generic
+** operation. Code in fixed memory (PF_FIXED) is never rewritten.
+** ===================================================================
+*/
+
+/* current instruction in the prototype's code */
+#define currinst(pc)	cast(Instruction *, (pc) - 1)
+
+#if LUA_USE_QUICKENING
+
+/*
+** Rewrite current instruction into opcode 'qop', if 'nomark' (that is,
+** the instruction is not marked against quickening) and its code is
+** not fixed.
+*/
+#define quicken(nomark,qop)  \
+  { if ((nomark) && !(cl->p->flag & PF_FIXED))  \
+      SET_OPCODE(*currinst(pc), qop); }
+
+#else
+
+#define quicken(nomark,qop)	((void)0)
+
+#endif
+
+
+/* rewrite current instruction back to generic opcode 'op', marking it */
+#define unquickenk(op)  \
+  { SET_OPCODE(*currinst(pc), op); SETARG_k(*currinst(pc), 1); }
+
+#define unquickenC(op)  \
+  { SET_OPCODE(*currinst(pc), op); SETARG_C(*currinst(pc), 1); }
+
+
+/*
+** Quickenable arithmetic operations with register operands. ('qiop'
+** and 'qfop' are the quickened opcodes for integers and floats.)
+*/
+#define op_arithq(L,iop,fop,qiop,qfop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (ttisinteger(v1) && ttisinteger(v2)) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    quicken(!TESTARG_k(i), qiop);  \
+    pc++; setivalue(vRA(i), iop(L, i1, i2));  \
+  }  \
+  else if (ttisfloat(v1) && ttisfloat(v2)) {  \
+    lua_Number n1 = fltvalue(v1); lua_Number n2 = fltvalue(v2);  \
+    quicken(!TESTARG_k(i), qfop);  \
+    pc++; setfltvalue(vRA(i), fop(L, n1, n2));  \
+  }  \
+  else op_arithf_aux(L, v1, v2, fop); }
+
+
+/*
+** Arithmetic operations quickened for integers.
+*/
+#define op_arithint(L,iop,fop,gop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisinteger(v1) && ttisinteger(v2))) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(vRA(i), iop(L, i1, i2));  \
+  }  \
+  else {  \
+    unquickenk(gop);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
+
+
+/*
+** Arithmetic operations quickened for floats.
+*/
+#define op_arithflt(L,iop,fop,gop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    lua_Number n1 = fltvalue(v1); lua_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(vRA(i), fop(L, n1, n2));  \
+  }  \
+  else {  \
+    unquickenk(gop);  \
+    op_arith_aux(L, v1, v2, iop, fop);  \
+  }}
+
+
+/*
+** Quickenable order operations with register operands.
+*/
+#define op_orderq(L,opi,opf,opn,other,qiop,qfop) {  \
+  TValue *ra = vRA(i); \
+  int cond;  \
+  TValue *rb = vRB(i);  \
+  if (ttisinteger(ra) && ttisinteger(rb)) {  \
+    lua_Integer ia = ivalue(ra);  \
+    lua_Integer ib = ivalue(rb);  \
+    cond = opi(ia, ib);  \
+    quicken(GETARG_C(i) == 0, qiop);  \
+  }  \
+  else if (ttisfloat(ra) && ttisfloat(rb)) {  \
+    cond = opf(fltvalue(ra), fltvalue(rb));  \
+    quicken(GETARG_C(i) == 0, qfop);  \
+  }  \
+  else if (ttisnumber(ra) && ttisnumber(rb))  \
+    cond = opn(ra, rb);  \
+  else  \
+    Protect(cond = other(L, ra, rb));  \
+  docondjump(); }
+
+
+/*
+** Order operations quickened for integers.
+*/
+#define op_orderint(L,opi,opn,other,gop) {  \
+  if (l_likely(ttisinteger(vRA(i)) && ttisinteger(vRB(i)))) {  \
+    int cond = opi(ivalue(vRA(i)), ivalue(vRB(i)));  \
+    docondjump();  \
+  }  \
+  else {  \
+    unquickenC(gop);  \
+    op_order(L, opi, opn, other);  \
+  }}
+
+
+/*
+** Order operations quickened for floats.
+*/
+#define op_orderflt(L,opi,opf,opn,other,gop) {  \
+  if (l_likely(ttisfloat(vRA(i)) && ttisfloat(vRB(i)))) {  \
+    int cond = opf(fltvalue(vRA(i)), fltvalue(vRB(i)));  \
+    docondjump();  \
+  }  \
+  else {  \
+    unquickenC(gop);  \
+    op_order(L, opi, opn, other);  \
+  }}
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Function 'luaV_execute': main interpreter loop
@@ -1120,11 +1485,23 @@ void luaV_finishOp (lua_State *L) {
 	{ if (l_unlikely(trap)) { updatebase(ci); ra = RA(i); } }
 
 
+/*
+** Charge one unit of the thread budget (see 'lua_setbudget') at a call
+** or at a backward jump. When the budget runs out, 'luaG_traceexec'
+** handles that before the next instruction.
+*/
+#define chargebudget(ci)  \
+	{ if (l_unlikely(L->budget != 0) && --L->budget == 0) \
+	    { L->hookmask |= MASKBUDGET; trap = ci->u.l.trap = 1; } }
+
+
 /*
 ** Execute a jump instruction. The 'updatetrap' allows signals to stop
 ** tight loops. (Without it, the local copy of 'trap' could never change.)
+** Backward jumps (loops) are charged to the thread budget.
 */
-#define dojump(ci,i,e)	{ pc += GETARG_sJ(i) + e; updatetrap(ci); }
+#define dojump(ci,i,e)	{ int sj = GETARG_sJ(i); \
+	pc += sj + e; if (sj < 0) chargebudget(ci); updatetrap(ci); }
 
 
 /* for test instructions, execute the jump instruction that follows it */
@@ -1181,6 +1558,51 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); }
 
 
+/*
+** {==================================================================
+** Opcode statistics (LUAI_OPSTATS build mode)
+** ===================================================================
+*/
+
+#if defined(LUAI_OPSTATS)
+
+#if defined(LUAI_OPCYCLES)
+
+/*
+** 'luai_opclock' should read a cheap, monotonic counter (such as the
+** time-stamp counter of the CPU).
+*/
+#if !defined(luai_opclock)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define luai_opclock()	cast(lua_Unsigned, __builtin_ia32_rdtsc())
+#else
+#error "option LUAI_OPCYCLES needs a definition for 'luai_opclock'"
+#endif
+#endif
+
+/* charge the time since the last instruction to the previous opcode */
+#define opcycles(s)	{ lua_Unsigned now_ = luai_opclock(); \
+  s->cycles[s->prev] += now_ - s->last; s->last = now_; }
+
+#else
+#define opcycles(s)	((void)0)
+#endif
+
+
+#define opstat(L,i)	{ OpStats *s_ = &G(L)->opstats; \
+  int o_ = GET_OPCODE(i); \
+  opcycles(s_); \
+  s_->count[o_]++; s_->pair[s_->prev][o_]++; s_->prev = o_; }
+
+#else
+
+#define opstat(L,i)	((void)0)
+
+#endif
+
+/* }================================================================== */
+
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
@@ -1188,6 +1610,7 @@ void luaV_finishOp (lua_State *L) {
     updatebase(ci);  /* correct stack */ \
   } \
   i = *(pc++); \
+  opstat(L, i); \
 }
 
 #define vmdispatch(o)	switch(o)
@@ -1303,7 +1726,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
         lu_byte tag;
-        luaV_fastget(upval, key, s2v(ra), luaH_getshortstr, tag);
+        fastgetic(upval, key, s2v(ra), icentry(cl->p, pc), tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, upval, rc, ra, tag));
         vmbreak;
@@ -1315,6 +1738,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lu_byte tag;
         if (ttisinteger(rc)) {  /* fast track for integers? */
           luaV_fastgeti(rb, ivalue(rc), s2v(ra), tag);
+          if (tag != LUA_VNOTABLE)
+            quicken(!TESTARG_k(i), OP_GETTABINT);
         }
         else
           luaV_fastget(rb, rc, s2v(ra), luaH_get, tag);
@@ -1341,7 +1766,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
         lu_byte tag;
-        luaV_fastget(rb, key, s2v(ra), luaH_getshortstr, tag);
+        fastgetic(rb, key, s2v(ra), icentry(cl->p, pc), tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, rb, rc, ra, tag));
         vmbreak;
@@ -1352,7 +1777,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
-        luaV_fastset(upval, key, rc, hres, luaH_psetshortstr);
+        fastsetic(upval, key, rc, icentry(cl->p, pc), hres);
         if (hres == HOK)
           luaV_finishfastset(L, upval, rc);
         else
@@ -1397,7 +1822,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
-        luaV_fastset(s2v(ra), key, rc, hres, luaH_psetshortstr);
+        fastsetic(s2v(ra), key, rc, icentry(cl->p, pc), hres);
         if (hres == HOK)
           luaV_finishfastset(L, s2v(ra), rc);
         else
@@ -1406,22 +1831,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       }
       vmcase(OP_NEWTABLE) {
         StkId ra = RA(i);
-        unsigned b = cast_uint(GETARG_vB(i));  /* log2(hash size) + 1 */
-        unsigned c = cast_uint(GETARG_vC(i));  /* array size */
-        Table *t;
-        if (b > 0)
-          b = 1u << (b - 1);  /* hash size is 2^(b - 1) */
-        if (TESTARG_k(i)) {  /* non-zero extra argument? */
-          lua_assert(GETARG_Ax(*pc) != 0);
-          /* add it to array size */
-          c += cast_uint(GETARG_Ax(*pc)) * (MAXARG_vC + 1);
-        }
-        pc++;  /* skip extra argument */
-        L->top.p = ra + 1;  /* correct top in case of emergency GC */
-        t = luaH_new(L);  /* memory allocation */
-        sethvalue2s(L, ra, t);
-        if (b != 0 || c != 0)
-          luaH_resize(L, t, c, b);  /* idem */
+        newtable(L, ra, i, *pc++);
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -1431,10 +1841,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = vRB(i);
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
+        unsigned int *ic = icentry(cl->p, pc);
         setobj2s(L, ra + 1, rb);
-        luaV_fastget(rb, key, s2v(ra), luaH_getshortstr, tag);
-        if (tagisempty(tag))
-          Protect(luaV_finishget(L, rb, rc, ra, tag));
+        fastgetic(rb, key, s2v(ra), ic, tag);
+        if (tagisempty(tag)) {
+          if (tag != LUA_VNOTABLE)  /* a table without the method? */
+            tag = icgetindex(L, hvalue(rb), key, s2v(ra), ic);
+          if (tagisempty(tag))
+            Protect(luaV_finishget(L, rb, rc, ra, tag));
+        }
         vmbreak;
       }
       vmcase(OP_ADDI) {
@@ -1504,15 +1919,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_ADD) {
-        op_arith(L, l_addi, luai_numadd);
+        op_arithq(L, l_addi, luai_numadd, OP_ADDINT, OP_ADDFLT);
         vmbreak;
       }
       vmcase(OP_SUB) {
-        op_arith(L, l_subi, luai_numsub);
+        op_arithq(L, l_subi, luai_numsub, OP_SUBINT, OP_SUBFLT);
         vmbreak;
       }
       vmcase(OP_MUL) {
-        op_arith(L, l_muli, luai_nummul);
+        op_arithq(L, l_muli, luai_nummul, OP_MULINT, OP_MULFLT);
         vmbreak;
       }
       vmcase(OP_MOD) {
@@ -1651,16 +2066,23 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         StkId ra = RA(i);
         int cond;
         TValue *rb = vRB(i);
-        Protect(cond = luaV_equalobj(L, s2v(ra), rb));
+        if (ttisinteger(s2v(ra)) && ttisinteger(rb)) {
+          cond = (ivalue(s2v(ra)) == ivalue(rb));
+          quicken(GETARG_C(i) == 0, OP_EQINT);
+        }
+        else
+          Protect(cond = luaV_equalobj(L, s2v(ra), rb));
         docondjump();
         vmbreak;
       }
       vmcase(OP_LT) {
-        op_order(L, l_lti, LTnum, lessthanothers);
+        op_orderq(L, l_lti, luai_numlt, LTnum, lessthanothers,
+                     OP_LTINT, OP_LTFLT);
         vmbreak;
       }
       vmcase(OP_LE) {
-        op_order(L, l_lei, LEnum, lessequalothers);
+        op_orderq(L, l_lei, luai_numle, LEnum, lessequalothers,
+                     OP_LEINT, OP_LEFLT);
         vmbreak;
       }
       vmcase(OP_EQK) {
@@ -1726,7 +2148,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           L->top.p = ra + b;  /* top signals number of arguments */
         /* else previous instruction set top */
         savepc(ci);  /* in case of errors */
-        if ((newci = luaD_precall(L, ra, nresults)) == NULL)
+        chargebudget(ci);
+        if (ttisLclosure(s2v(ra))) {  /* Lua function? */
+          /* fast path: same as the Lua case in 'luaD_precall' */
+          Proto *p = clLvalue(s2v(ra))->p;
+          checkstackp(L, p->maxstacksize, ra);
+          ci = luaD_precallLua(L, ra, cast_uint(nresults + 1), p);
+          goto startfunc;
+        }
+        else if ((newci = luaD_precall(L, ra, nresults)) == NULL)
           updatetrap(ci);  /* C call; nothing else to be done */
         else {  /* Lua call: run function in this same C frame */
           ci = newci;
@@ -1746,6 +2176,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         else  /* previous instruction set top */
           b = cast_int(L->top.p - ra);
         savepc(ci);  /* several calls here can raise errors */
+        chargebudget(ci);
         if (TESTARG_k(i)) {
           luaF_closeupval(L, base);  /* close upvalues from current call */
           lua_assert(L->tbclist.p < base);  /* no pending tbc variables */
@@ -1839,10 +2270,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             idx = intop(+, idx, step);  /* add step to index */
             chgivalue(s2v(ra + 2), idx);  /* update control variable */
             pc -= GETARG_Bx(i);  /* jump back */
+            chargebudget(ci);
           }
         }
-        else if (floatforloop(ra))  /* float loop */
+        else if (floatforloop(ra)) {  /* float loop */
           pc -= GETARG_Bx(i);  /* jump back */
+          chargebudget(ci);
+        }
         updatetrap(ci);  /* allows a signal to break the loop */
         vmbreak;
       }
@@ -1869,6 +2303,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         halfProtect(luaF_newtbcupval(L, ra + 2));
         pc += GETARG_Bx(i);  /* go to end of the loop */
         i = *(pc++);  /* fetch next instruction */
+        opstat(L, i);
         lua_assert(GET_OPCODE(i) == OP_TFORCALL && ra == RA(i));
         goto l_tforcall;
       }
@@ -1888,14 +2323,17 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         ProtectNT(luaD_call(L, ra + 3, GETARG_C(i)));  /* do the call */
         updatestack(ci);  /* stack may have changed */
         i = *(pc++);  /* go to next instruction */
+        opstat(L, i);
         lua_assert(GET_OPCODE(i) == OP_TFORLOOP && ra == RA(i));
         goto l_tforloop;
       }}
       vmcase(OP_TFORLOOP) {
        l_tforloop: {
         StkId ra = RA(i);
-        if (!ttisnil(s2v(ra + 3)))  /* continue loop? */
+        if (!ttisnil(s2v(ra + 3))) {  /* continue loop? */
           pc -= GETARG_Bx(i);  /* jump back */
+          chargebudget(ci);
+        }
         vmbreak;
       }}
       vmcase(OP_SETLIST) {
@@ -1929,15 +2367,31 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       vmcase(OP_CLOSURE) {
         StkId ra = RA(i);
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        LClosure *ncl = getcached(p, cl->upvals, base);  /* cached closure */
+        if (ncl == NULL)  /* no match? */
+          halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        else
+          setclLvalue2s(L, ra, ncl);  /* push cached closure */
         checkGC(L, ra + 1);
         vmbreak;
       }
       vmcase(OP_VARARG) {
         StkId ra = RA(i);
         int n = GETARG_C(i) - 1;  /* required results (-1 means all) */
-        int vatab = GETARG_k(i) ? GETARG_B(i) : -1;
-        Protect(luaT_getvarargs(L, ci, ra, n, vatab));
+        int nextra = ci->u.l.nextraargs;
+        if (!GETARG_k(i) &&  /* no vararg table? */
+            (n >= 0 || L->stack_last.p - ra > nextra)) {  /* enough stack? */
+          /* fast path for 'luaT_getvarargs': copy hidden arguments */
+          if (n < 0) {  /* get all extra arguments? */
+            n = nextra;
+            L->top.p = ra + nextra;  /* next instruction will need top */
+          }
+          luaT_gethiddenargs(L, ci, ra, n);
+        }
+        else {
+          int vatab = GETARG_k(i) ? GETARG_B(i) : -1;
+          Protect(luaT_getvarargs(L, ci, ra, n, vatab));
+        }
         vmbreak;
       }
       vmcase(OP_GETVARG) {
@@ -1953,7 +2407,17 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_VARARGPREP) {
-        ProtectNT(luaT_adjustvarargs(L, ci, cl->p));
+        Proto *p = cl->p;
+        if ((p->flag & PF_VAHID) &&  /* hidden arguments? */
+            L->stack_last.p - L->top.p > p->maxstacksize + 1) {
+          /* fast path for 'luaT_adjustvarargs': enough stack */
+          luaT_buildhiddenargs(L, ci, p);
+          updatetrap(ci);  /* 'luaG_tracecall' may have set it */
+        }
+        else
+          ProtectNT(luaT_adjustvarargs(L, ci, p));
+        /* frame may have moved to registers not erased by the call */
+        clearprivregs(p, L->top.p, ci->top.p);
         if (l_unlikely(trap)) {  /* previous "Protect" updated trap */
           luaD_hookcall(L, ci);
           L->oldpc = 1;  /* next opcode will be seen as a "new" line */
@@ -1965,6 +2429,93 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_ADDINT) {
+        op_arithint(L, l_addi, luai_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_ADDFLT) {
+        op_arithflt(L, l_addi, luai_numadd, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUBINT) {
+        op_arithint(L, l_subi, luai_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_SUBFLT) {
+        op_arithflt(L, l_subi, luai_numsub, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MULINT) {
+        op_arithint(L, l_muli, luai_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_MULFLT) {
+        op_arithflt(L, l_muli, luai_nummul, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_EQINT) {
+        StkId ra = RA(i);
+        TValue *rb = vRB(i);
+        int cond;
+        if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(rb)))
+          cond = (ivalue(s2v(ra)) == ivalue(rb));
+        else {
+          unquickenC(OP_EQ);
+          Protect(cond = luaV_equalobj(L, s2v(ra), rb));
+        }
+        docondjump();
+        vmbreak;
+      }
+      vmcase(OP_LTINT) {
+        op_orderint(L, l_lti, LTnum, lessthanothers, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LTFLT) {
+        op_orderflt(L, l_lti, luai_numlt, LTnum, lessthanothers, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LEINT) {
+        op_orderint(L, l_lei, LEnum, lessequalothers, OP_LE);
+        vmbreak;
+      }
+      vmcase(OP_LEFLT) {
+        op_orderflt(L, l_lei, luai_numle, LEnum, lessequalothers, OP_LE);
+        vmbreak;
+      }
+      vmcase(OP_GETTABINT) {
+        StkId ra = RA(i);
+        TValue *rb = vRB(i);
+        TValue *rc = vRC(i);
+        lu_byte tag;
+        if (l_likely(ttistable(rb) && ttisinteger(rc))) {
+          luaH_fastgeti(hvalue(rb), ivalue(rc), s2v(ra), tag);
+        }
+        else {
+          unquickenk(OP_GETTABLE);
+          if (ttisinteger(rc)) {
+            luaV_fastgeti(rb, ivalue(rc), s2v(ra), tag);
+          }
+          else
+            luaV_fastget(rb, rc, s2v(ra), luaH_get, tag);
+        }
+        if (tagisempty(tag))
+          Protect(luaV_finishget(L, rb, rc, ra, tag));
+        vmbreak;
+      }
+      vmcase(OP_NEWTABLEP) {
+        StkId ra = RA(i);
+        if (ttistable(s2v(ra)) && isprivate(hvalue(s2v(ra)))) {
+          /* reuse private table, with the sizes of this constructor */
+          unsigned b, c;
+          tablesizes(i, *pc++, &b, &c);
+          L->top.p = ra + 1;  /* correct top in case of emergency GC */
+          luaH_clear(L, hvalue(s2v(ra)), c, b);
+        }
+        else
+          setprivate(newtable(L, ra, i, *pc++));
+        checkGC(L, ra + 1);
+        vmbreak;
+      }
     }
   }
 }
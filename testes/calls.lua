@@ -115,6 +115,38 @@ end
 deep(10)
 deep(180)
 
+do  -- deep recursion spans several blocks of CallInfos
+  local function rec (n) if n > 0 then return 1 + rec(n - 1) end return 0 end
+  assert(rec(5000) == 5000)
+  local co = coroutine.wrap(function (n) coroutine.yield(rec(n)); return 0 end)
+  assert(co(3000) == 3000 and rec(100) == 100 and co() == 0)
+  if T then
+    local nci = select(4, T.stacklevel())
+    collectgarbage()
+    local nci1 = select(4, T.stacklevel())
+    assert(nci1 < nci)   -- unused blocks were freed
+    assert(rec(5000) == 5000)
+  end
+end
+
+
+do  -- calls to Lua functions: missing arguments and stack growth
+  local function f (a, b, c, d) return a, b, c, d end
+  local function big (n, x)
+    -- many registers, so that each call may need to grow the stack
+    local a1, a2, a3, a4, a5, a6, a7, a8, a9, a10 = n, n, n, n, n
+    if n > 0 then return big(n - 1, x) + 1 end
+    return select("#", f(x)) + (a10 == nil and a1 or -1)
+  end
+  for i = 1, 3 do
+    local a, b, c, d = f(i)
+    assert(a == i and b == nil and c == nil and d == nil)
+  end
+  assert(big(2000, 1) == 2004)
+  local co = coroutine.wrap(big)
+  assert(co(500) == 504)
+end
+
 
 print"testing tail calls"
 
@@ -276,4 +276,39 @@ assert(not pcall(debug.upvaluejoin, print, 1, foo2, 1))
 assert(not pcall(debug.upvaluejoin, {}, 1, foo2, 1))
 assert(not pcall(debug.upvaluejoin, foo1, 1, print, 1))
 
+
+do  print("testing cache of closures")
+  collectgarbage("stop")   -- a collection could clear the cache
+  local function mk () return function (x) return x end end
+  assert(mk() == mk())     -- no upvalues: closure is reused
+  local function mk1 () return function () return mk end end
+  assert(mk1() == mk1())   -- same upvalue: closure is reused
+  local function mk2 (a) return function () return a end end
+  local f1, f2 = mk2(1), mk2(2)
+  assert(f1 ~= f2 and f1() == 1 and f2() == 2)
+  local t = {}
+  for i = 1, 3 do t[i] = function () return i end end
+  assert(t[1] ~= t[2] and t[1]() == 1 and t[3]() == 3)
+  -- too many misses make the prototype give up its cache
+  for i = 1, 20 do assert(mk2(i)() == i) end
+  local g = mk2(0)
+  assert(g() == 0)
+  collectgarbage("restart")
+
+  -- cached closures can be collected
+  local w = setmetatable({}, {__mode = "k"})
+  w[mk()] = true
+  collectgarbage(); collectgarbage()
+  assert(next(w) == nil)
+  assert(mk()(10) == 10)
+
+  local oldmode = collectgarbage("generational")
+  for i = 1, 100 do
+    local f = mk()
+    assert(f(i) == i and mk1()() == mk)
+    if i % 10 == 0 then collectgarbage("step") end
+  end
+  collectgarbage(oldmode)
+end
+
 print'OK'
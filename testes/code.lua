@@ -101,10 +101,11 @@ end
 
 
 -- check that 'f' opcodes match '...' and that 'f(p) == r'.
+-- (opcodes are checked before the call, which may quicken them)
 local function checkR (f, p, r, ...)
+  check(f, ...)
   local r1 = f(p)
   assert(r == r1 and math.type(r) == math.type(r1))
-  check(f, ...)
 end
 
 
@@ -500,5 +501,300 @@ do   print("testing code for integer limits")
 
 end
 
+
+do   print("testing quickening")
+  local function ops (f)
+    local c = T.listcode(f)
+    local t = {}
+    for i = 1, #c do t[#t + 1] = string.match(c[i], "%u%w+") end
+    return table.concat(t, " ")
+  end
+
+  local function f (a, b, t)
+    local x = a + b
+    local y = a * b - x
+    if a < b and a <= b and a == b then y = y + 1 end
+    return x, y, t[a]
+  end
+  local generic = ops(f)
+
+  -- integers quicken to integer opcodes
+  assert(select(3, f(2, 1, {0, 10})) == 10)
+  local s = ops(f)
+  assert(string.find(s, "ADDINT") and string.find(s, "MULINT") and
+         string.find(s, "SUBINT") and string.find(s, "LTINT") and
+         string.find(s, "GETTABINT"))
+  -- comparisons not executed yet
+  assert(not string.find(s, "LEINT") and not string.find(s, "EQINT"))
+  f(1, 2, {})
+  assert(string.find(ops(f), "LEINT") and string.find(ops(f), "EQINT"))
+
+  -- other types go back to the generic form, for good
+  local x, y = f(1.5, 2.5, {[1.5] = 3})
+  assert(x == 4.0 and y == 3.75 - 4.0)
+  assert(ops(f) == generic)
+  f(1, 2, {10})
+  assert(ops(f) == generic)
+
+  -- floats quicken to float opcodes
+  local function g (a, b) local c = a + b; return a < b, c end
+  local r, c = g(1.0, 2.5)
+  assert(r and c == 3.5)
+  assert(string.find(ops(g), "ADDFLT") and string.find(ops(g), "LTFLT"))
+  -- mixed operands still work after quickening
+  r, c = g(1, 2.5)
+  assert(r and c == 3.5 and not string.find(ops(g), "FLT"))
+
+  -- dumps always have the generic form
+  local g1 = load(string.dump(g))
+  assert(ops(g1) == ops(g))
+  local function h (a, b) return a - b end
+  local generich = ops(h)
+  assert(h(10, 3) == 7 and ops(h) ~= generich)
+  local h1 = load(string.dump(h))
+  assert(ops(h1) == generich and h1(10, 3) == 7)
+
+  -- metamethods and errors in quickened instructions
+  local mt = {__lt = function () return true end,
+              __index = function (_, k) return k * 2 end}
+  local function l (a, b) return a < b end
+  assert(l(2, 1) == false and string.find(ops(l), "LTINT"))
+  assert(l(setmetatable({}, mt), {}) == true)
+  local function gt (t, k) return t[k] end
+  assert(gt({1}, 1) == 1 and string.find(ops(gt), "GETTABINT"))
+  assert(gt(setmetatable({}, mt), 21) == 42)
+  assert(string.find(ops(gt), "GETTABINT"))
+  local st, msg = pcall(gt, 10, 1)
+  assert(not st and string.find(msg, "index a number value"))
+end
+
+do   print("testing bytecode optimizer")
+  -- load 'src' with and without optimizations
+  local function both (src)
+    return assert(load(src, "=opt", "t")), assert(load(src, "=opt", "tO"))
+  end
+
+  -- strength reduction: 'i % 8' over an integer loop becomes 'i & 7'
+  local src = [[
+    local s = 0
+    for i = 1, 100 do s = s + i % 8 end
+    return s
+  ]]
+  local f, fo = both(src)
+  check(f, 'VARARGPREP', 'LOADI', 'LOADI', 'LOADI', 'LOADI', 'FORPREP',
+           'MODK', 'MMBINK', 'ADD', 'MMBIN', 'FORLOOP', 'RETURN', 'RETURN')
+  check(fo, 'VARARGPREP', 'LOADI', 'LOADI', 'LOADI', 'LOADI', 'FORPREP',
+           'BANDK', 'MMBINK', 'ADD', 'MMBIN', 'FORLOOP', 'RETURN', 'RETURN')
+  assert(f() == fo() and fo() == 346)
+  -- not with a float loop or a non-power-of-two divisor
+  f, fo = both("local s = 0; for i = 1.0, 10 do s = s + i % 8 end; return s")
+  checkequal(f, fo); assert(fo() == 31.0)
+  f, fo = both("local s = 0; for i = 1, 10 do s = s + i % 6 end; return s")
+  checkequal(f, fo)
+
+  -- dead stores and copies
+  f, fo = both([[
+    local a, b = ...
+    local x = nil
+    x = 3
+    local y; y, b = a + b, 1
+    return x, y, b
+  ]])
+  check(fo, 'VARARGPREP', 'VARARG', 'LOADI', 'LOADNIL', 'ADD', 'MMBIN',
+            'LOADI', 'MOVE', 'MOVE', 'MOVE', 'RETURN', 'RETURN')
+  local x, y, b = fo(2, 3)
+  assert(x == 3 and y == 5 and b == 1)
+  -- no copy when the variable is captured
+  f, fo = both([[
+    local a, b = ...
+    local y; y, b = a + b, 1
+    return function () return y end
+  ]])
+  checkequal(f, fo)
+
+  -- jumps to returns become returns
+  fo = select(2, both("return function (c) if c then c = 1 else c = 2 end end"))()
+  check(fo, 'TEST', 'JMP', 'LOADI', 'RETURN0', 'LOADI', 'RETURN0')
+  assert(fo(true) == nil and fo(false) == nil)
+
+  -- a fresh table stays in its own register (see 'iscopysource')
+  fo = select(2, both([[
+    local u, b
+    b = {34}
+    for i = 1, 100 do u = {}; collectgarbage() end
+    return b[1]
+  ]]))
+  assert(fo() == 34)
+
+  -- line information survives the removal of instructions
+  fo = select(2, both("local a = nil\na = 1\n\nlocal b = a.x"))
+  local st, msg = pcall(fo)
+  assert(not st and string.find(msg, "^opt:4:"))
+
+  -- optimized test files must run the same checks as the originals
+  for _, name in ipairs{"constructs.lua", "nextvar.lua", "math.lua"} do
+    local file = assert(io.open(name))
+    local src = string.gsub(file:read("a"), "^#[^\n]*", "")
+    file:close()
+    assert(load(src, "@" .. name, "tO"))
+  end
+end
+
+
+do   print("testing private tables")
+  local function codeof (f) return table.concat(T.listcode(f), " ") end
+  local src = [[
+    local n = ...
+    local s = 0
+    for i = 1, n do
+      local p = {x = i, y = 2 * i}
+      local q = {p.y, p.x}
+      if i == 1 then p.z = 10; q[3] = 1 end
+      s = s + p.x + p.y + q[1] + #q + (p.z or 0)
+    end
+    return s
+  ]]
+  local f, fo = load(src, "=priv", "t"), load(src, "=priv", "tO")
+  assert(not string.find(codeof(f), "NEWTABLEP"))
+  assert(select(2, string.gsub(codeof(fo), "NEWTABLEP", "")) == 2)
+  assert(f(100) == fo(100) and fo(100) == 25461)
+
+  -- reused tables do not create garbage ('q' cannot be reused, because
+  -- its register holds a temporary when its constructor runs again)
+  local function alloc (f)
+    collectgarbage(); collectgarbage("stop")
+    local m = collectgarbage("count")
+    f(10000)
+    m = collectgarbage("count") - m
+    collectgarbage("restart")
+    return m
+  end
+  assert(alloc(fo) < alloc(f) * 0.6)
+
+  -- tables that escape (the first one in each chunk)
+  for _, s in ipairs{
+    "local t = {}; return t",
+    "local t = {}; g(t)",
+    "local t = {}; local u = {}; u[t] = 1",
+    "local t = {}; local u = {}; u.x = t",
+    "local t = {}; return function () return t end",
+    "local t = {}; return t == ...",
+    "local t = {}; return t .. 'x'",
+    "local t = {}; t:m()",
+  } do
+    assert(string.match(codeof(load(s, "", "tO")), "NEWTABLEP?") == "NEWTABLE")
+  end
+  -- inner table goes into the outer one
+  assert(string.find(codeof(load("local a = {{}}", "", "tO")),
+                     "NEWTABLEP .* NEWTABLE "))
+
+  -- the debug library can still get a private table
+  fo = load([[
+    local getp, t = ..., {}
+    for i = 1, 3 do
+      local p = {i}
+      t[i] = getp()
+      assert(p[1] == i)
+    end
+    return t
+  ]], "=priv", "tO")
+  assert(string.find(codeof(fo), "NEWTABLEP"))
+  local t = fo(function ()
+    for i = 1, math.huge do
+      local name, value = require"debug".getlocal(2, i)
+      if name == "p" then return value end
+    end
+  end)
+  assert(t[1][1] == 1 and t[2][1] == 2 and t[3][1] == 3)
+  assert(t[1] ~= t[2] and t[2] ~= t[3])
+
+  -- a register may hold a private table from another constructor (with
+  -- other sizes) or left by a dead frame of another function
+  fo = load([[
+    local s = 0
+    local function g () local t = {} t.a = 1 return 0 end
+    local function h () local u = {1, 2, 3, 4, 5, 6, 7, 8} return u[8] end
+    for i = 1, 5 do g(); s = s + h() end
+    for i = 1, 5 do
+      do local t = {} t.a = i; s = s + t.a end
+      do local u = {1, 2, 3, 4, 5, 6, 7, 8}; s = s + u[8] + #u end
+    end
+    return s
+  ]], "=priv", "tO")
+  assert(fo() == 40 + 15 + 80)
+end
+
+
+do   print("testing inlining")
+  local src = [[
+    local k = 10
+    local add <const> = function (a, b) return a + b end
+    local clamp <const> = function (x, lo, hi)
+      if x < lo then x = lo elseif x > hi then x = hi end
+      return x
+    end
+    local getk <const> = function () return k end
+    local setk <const> = function (v) k = v; return v end
+    local other = function () return k end
+    local pi <const> = function () return math.pi // 1 end
+    local two <const> = function (...) return ... end   -- vararg
+    local s = 0
+    for i = 1, 10 do s = s + clamp(i, 3, 7) end
+    setk(5)
+    assert(getk() == 5 and other() == 5 and k == 5)
+    return s, add(s, pi()), add(two(1, 2)), pi"x", select('#', add(1, 2))
+  ]]
+  local f, fo = load(src, "=inl", "t"), load(src, "=inl", "tO")
+  local t, to = {f()}, {fo()}
+  assert(#t == 5 and #to == 5)
+  for i = 1, #t do assert(t[i] == to[i]) end
+
+  -- a small function inlined: no calls are left
+  fo = load([[
+    local add <const> = function (a, b)
+      return a + b
+    end
+    local x = ...
+    return add(x, 1), add(x, 2, 3), add(x)
+  ]], "=inl", "tO")
+  assert(not string.find(table.concat(T.listcode(fo), " "), "CALL"))
+  local st, msg = pcall(fo, 10)   -- error inside 'add'
+  assert(not st and string.find(msg, "^inl:2: .- nil value"))
+  fo = load("local add <const> = function (a, b) return a + b end\n" ..
+            "return add(..., 1), add(..., 2, 3)", "=inl", "tO")
+  local a, b = fo(10)
+  assert(a == 11 and b == 12)
+
+  -- not inlined: non-constant local, vararg call, mode without 'O'
+  for _, s in ipairs{
+    "local f = function (a) return a end; return f(1)",
+    "local f <const> = function (a) return a end; return f(...)",
+  } do
+    assert(string.find(table.concat(T.listcode(load(s, "", "tO")), " "),
+           "CALL"))
+  end
+  assert(string.find(table.concat(T.listcode(load([[
+    local f <const> = function (a) return a end; return f(1)]], "", "t")),
+    " "), "CALL"))
+
+  -- a call that cannot be inlined leaves no constants of the callee
+  fo = load([[
+    local f <const> = function (x) x.orphan = 1.5; return {} end
+    return f({})
+  ]], "", "tO")
+  assert(string.find(table.concat(T.listcode(fo), " "), "CALL"))
+  for _, k in ipairs(T.listk(fo)) do assert(k ~= "orphan" and k ~= 1.5) end
+
+  -- not inlined when its constants might not fit in the caller
+  local t = {"local get <const> = function (t) return t.last end",
+             "local t = {}"}
+  for i = 1, 300 do t[#t + 1] = string.format("t.k%d = 1", i) end
+  t[#t + 1] = "t.last = 10; return get(t)"
+  fo = load(table.concat(t, "\n"), "", "tO")
+  assert(string.find(table.concat(T.listcode(fo), " "), "CALL"))
+  assert(fo() == 10)
+end
+
+
 print 'OK'
 
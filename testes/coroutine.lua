@@ -1049,6 +1049,94 @@ assert(run(function ()
            end, {"for", "for", "for"}) == 10)
 
 
+print"testing budgets"
+
+do
+  -- run coroutine 'co' until it finishes; return its results and the
+  -- number of times it was preempted
+  local function slices (co, ...)
+    local n = 0
+    local res = table.pack(coroutine.resume(co, ...))
+    while coroutine.status(co) ~= "dead" do
+      assert(res[1] and res.n == 1)   -- preempted: no values
+      n = n + 1
+      res = table.pack(coroutine.resume(co))
+    end
+    assert(res[1])
+    return n, table.unpack(res, 2, res.n)
+  end
+
+  local function numfor (n)
+    local s = 0
+    for i = 1, n do s = s + i end
+    return s
+  end
+  local co = coroutine.create(numfor)
+  debug.setbudget(co, 100)
+  local n, s = slices(co, 10000)
+  assert(s == 50005000 and 99 <= n and n <= 101)
+
+  -- summing an array
+  local a = {}
+  for i = 1, 100000 do a[i] = i end
+  co = coroutine.create(function ()
+    local t = a
+    local s = 0
+    for i = 1, #t do s = s + t[i] end
+    return s
+  end)
+  debug.setbudget(co, 1000)
+  n, s = slices(co)
+  assert(s == 5000050000 and 99 <= n and n <= 101)
+
+  -- other loops and calls
+  local function loops (n)
+    local s, i = 0, 0
+    while i < n do i = i + 1; s = s + i end
+    repeat i = i - 1; s = s - 1 until i == 0
+    for k, v in ipairs({10, 20, 30}) do s = s + v end
+    for x = 0.5, 2.5 do s = s + x end
+    local function rec (k) if k > 0 then return rec(k - 1) + 1 end return 0 end
+    local function tail (k) if k > 0 then return tail(k - 1) end return k end
+    return s + rec(200) + tail(300)
+  end
+  co = coroutine.create(loops)
+  debug.setbudget(co, 10)
+  local n, s = slices(co, 100)
+  assert(s == 5050 - 100 + 60 + 4.5 + 200 and n >= (200 + 200 + 300) // 10)
+
+  -- no budget: no preemption
+  co = coroutine.create(numfor)
+  debug.setbudget(co, 10)
+  debug.setbudget(co)
+  assert(slices(co, 1000) == 0)
+
+  -- new coroutines inherit the budget
+  debug.setbudget(100)   -- main thread cannot yield; budget is ignored
+  assert(numfor(1000) == 500500)
+  co = coroutine.create(numfor)
+  debug.setbudget()
+  local n = slices(co, 1000)
+  assert(9 <= n and n <= 11)
+  assert(slices(coroutine.create(numfor), 1000) == 0)
+
+  -- budget with count hook and with a non-yieldable call
+  co = coroutine.create(function (n)
+    local c = 0
+    debug.sethook(function () c = c + 1 end, "", 1)
+    local s = numfor(n)
+    debug.sethook()
+    local t = table.pack(pcall(string.gsub, "abc", "%w", function (x)
+      return numfor(100)   -- inside a C function: cannot yield
+    end))
+    return s + c * 0, t[1] and t[3]
+  end)
+  debug.setbudget(co, 10)
+  local n, s, k = slices(co, 200)
+  assert(s == 20100 and k == 3 and n >= 20)
+end
+
+
 
 -- tests for coroutine API
 if T==nil then
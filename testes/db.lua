@@ -211,6 +211,26 @@ end
 _G.a = nil
 
 
+do   -- current lines in a long function (they come from a direct map
+     -- built at the first query)
+  local code = {"local getinfo = ...; return function (t)"}
+  for i = 1, 300 do
+    code[#code + 1] = "t[#t + 1] = getinfo(1, 'l').currentline"
+    code[#code + 1] = string.rep("\n", i % 5)
+  end
+  code[#code + 1] = "return t end"
+  local f = load(table.concat(code, "\n"))(debug.getinfo)
+  local t1 = f({})
+  local t2 = f({})
+  local line = 1
+  for i = 1, 300 do
+    line = line + 1
+    assert(t1[i] == line and t2[i] == line)
+    line = line + i % 5 + 1
+  end
+end
+
+
 do   -- testing active lines
   local function checkactivelines (f, lines)
     local t = debug.getinfo(f, "SL")
@@ -1062,5 +1082,73 @@ do   -- tests for 'source' in binary dumps
          debug.getinfo(h).source == '=?')
 end
 
+
+do  print("testing sampling profiler")
+  local function busy (n)
+    local s = 0
+    for i = 1, n do s = s + i % 7 end
+    return s
+  end
+  local function sampled (pat)   -- some sample matches 'pat'?
+    local s = debug.profile("dump")
+    return string.find("\n" .. s, "\n" .. pat)
+  end
+  local ok, msg = debug.profile("start", 0.001, 50)
+  if not ok then
+    print("  profiler not available: " .. msg)
+  else
+    local co = coroutine.wrap(function ()
+      while true do local x = busy(1000); coroutine.yield(x) end
+    end)
+    -- samples in the main thread start with the main chunk; samples
+    -- in the coroutine start with its body (a function without name)
+    local inmain = "[^\n]*main chunk@[^\n]*;busy@"
+    local inco = "function:%d+@[^;\n]*;busy@"
+    local t = os.clock()
+    repeat
+      local x = busy(1000) + co()
+    until sampled(inmain) and sampled(inco) or os.clock() - t > 10
+    debug.profile("stop")
+    assert(sampled(inmain) and sampled(inco))
+    local s, n = debug.profile("dump")
+    local total = 0
+    for stack, c in string.gmatch(s, "([^\n]+) (%d+)\n") do
+      total = total + tonumber(c)
+    end
+    assert(total == math.min(n, 50))   -- ring buffer keeps last 50 samples
+    busy(1e6)
+    assert(select(2, debug.profile("dump")) == n)   -- no samples after stop
+  end
+  assert(not pcall(debug.profile, "x"))
+end
+
+
+do   -- testing opcode statistics
+  if not debug.opstats() then
+    print("\n >>> opcode statistics not available <<<\n")
+  else
+    local function f (n)
+      local s = 0
+      for i = 1, n do s = s + i end
+      return s
+    end
+    debug.opstats("reset")
+    assert(f(1000) == 500500)
+    local count, pairs, cycles = debug.opstats()
+    assert(count.FORLOOP >= 1000 and count.NOTANOPCODE == nil)
+    local total, after = 0, 0
+    for op, n in next, count do total = total + n end
+    for p, n in next, pairs do
+      local a, b = string.match(p, "^(%w+) (%w+)$")
+      assert(count[a] and count[b] >= n)
+      if a == "FORLOOP" then after = after + n end
+    end
+    assert(total >= 2000 and after >= 1000)
+    debug.opstats("reset")
+    assert(debug.opstats().FORLOOP == nil)
+    assert(not pcall(debug.opstats, "x"))
+  end
+end
+
 print"OK"
 
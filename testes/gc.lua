@@ -75,6 +75,85 @@ do  print("steps")
 end
 
 
+do  print("barriers during a cycle")
+  -- tables traversed during a cycle get new objects and are traversed
+  -- again (incrementally and then in the atomic phase)
+  local old = {}
+  for i = 1, 100 do old[i] = {} end
+  local weak = setmetatable({}, {__mode = "v"})
+  collectgarbage()
+  local n = 0
+  repeat
+    for i = 1, 10 do
+      n = n + 1
+      local t = old[n % 100 + 1]
+      t[#t + 1] = {n}
+      weak[n] = {}   -- garbage
+    end
+  until collectgarbage("step", 0)
+  local total = 0
+  for i = 1, 100 do
+    local t = old[i]
+    for j = 1, #t do
+      assert(t[j][1] % 100 + 1 == i)
+    end
+    total = total + #t
+  end
+  assert(total == n)
+  collectgarbage()
+  assert(next(weak) == nil)
+end
+
+
+do  print("time-budgeted steps")
+  local old = collectgarbage("param", "steptime", 100)
+  assert(old == 0 and collectgarbage("param", "steptime") == 100)
+  local cycles = collectgarbage("stats").total.major
+  local keep = {}
+  local weak = setmetatable({}, {__mode = "k"})
+  for i = 1, 100000 do
+    keep[i % 1000 + 1] = {i}
+    weak[{}] = i
+  end
+  repeat until collectgarbage("step", 0)
+  assert(collectgarbage("stats").total.major > cycles)
+  for i = 1, 1000 do
+    assert(keep[i][1] % 1000 + 1 == i)
+  end
+  collectgarbage()
+  assert(next(weak) == nil)
+  collectgarbage("param", "steptime", old)
+end
+
+
+do  print("statistics")
+  collectgarbage()
+  local garbage = {}
+  for i = 1, 1000 do garbage[i] = {} end
+  garbage = nil
+  collectgarbage()
+  local s = collectgarbage("stats")
+  assert(s.major == 1 and s.minor == 0)
+  assert(s.marked > 0 and s.freed >= 1000 and s.swept >= s.freed)
+  for _, k in ipairs{"propagate", "atomic", "sweep", "callfin", "maxstep"} do
+    assert(math.type(s[k]) == "float" and s[k] >= 0)
+  end
+  local total = s.total
+  assert(total.major >= 1 and total.freed >= s.freed)
+  assert(total.maxstep >= s.maxstep and total.sweep >= s.sweep)
+  -- a cycle done in steps
+  repeat until collectgarbage("step", 0)
+  s = collectgarbage("stats")
+  assert(s.major == 1 and s.marked > 0)
+  assert(s.total.major > total.major and s.total.swept > total.swept)
+  -- not available inside finalizers
+  local res = true
+  setmetatable({}, {__gc = function () res = collectgarbage("stats") end})
+  collectgarbage()
+  assert(res == nil)
+end
+
+
 _G["while"] = 234
 
 
@@ -392,6 +471,16 @@ if T then
   getmetatable(u).__gc = nil
   warn("@normal")
 
+  -- error message in a string buffer shared with longer strings
+  local msg = string.rep("x", 100) .. "@buffered@"
+  local other = msg .. "yyy"
+  setmetatable({}, {__gc = function () error(msg, 0) end})
+  warn("@store")
+  collectgarbage()
+  assert(_WARN == "error in __gc (" .. msg .. ")"); _WARN = false
+  warn("@normal")
+  assert(other == msg .. "yyy")
+
 end
 print '+'
 
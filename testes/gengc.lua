@@ -177,6 +177,21 @@ do  print"testing stop-the-world collection"
 end
 
 
+do  print("statistics of minor collections")
+  collectgarbage("generational")
+  collectgarbage()   -- a major collection
+  local s = collectgarbage("stats")
+  assert(s.major == 1 and s.minor == 0)
+  local t = {}
+  for i = 1, 100 do t[i] = {} end
+  t = nil
+  collectgarbage("step")   -- a minor collection
+  s = collectgarbage("stats")
+  assert(s.minor == 1 and s.major == 0 and s.freed >= 100)
+  assert(s.total.minor >= 1 and s.total.major >= 1)
+end
+
+
 if T then   -- test GC parameter codification
   for _, percentage in ipairs{5, 10, 12, 20, 50, 100, 200, 500} do
     local param = T.codeparam(percentage)   -- codify percentage
@@ -934,6 +934,107 @@ end
 assert(i == a.n)
 
 
+do   print("testing inline caches for field accesses")
+  local function getx (t) return t.x end
+  local function setx (t, v) t.x = v end
+
+  -- same site with tables of different layouts
+  local ts = {{x = 1}, {y = 2, x = 2}, {a = 1, b = 2, c = 3, x = 3},
+              setmetatable({}, {__index = {x = 4}}), {}}
+  for _ = 1, 3 do
+    for i = 1, 4 do assert(getx(ts[i]) == i) end
+    assert(getx(ts[5]) == nil)
+  end
+
+  -- rehash moves the key
+  local t = {x = 10}
+  assert(getx(t) == 10)
+  for i = 1, 100 do t["k" .. i] = i end
+  assert(getx(t) == 10)
+  setx(t, 20); assert(t.x == 20 and getx(t) == 20)
+
+  -- removed key must not be found through the cache
+  t.x = nil
+  assert(getx(t) == nil)
+  setmetatable(t, {__index = function (_, k) return k end,
+                   __newindex = function (t, k, v) rawset(t, k, v * 2) end})
+  assert(getx(t) == "x")
+  setx(t, 3); assert(rawget(t, "x") == 6 and getx(t) == 6)
+
+  -- methods and globals
+  local obj = {n = 0, inc = function (self) self.n = self.n + 1 end}
+  for _ = 1, 10 do obj:inc() end
+  assert(obj.n == 10)
+  local C = {inc = obj.inc}
+  C.__index = C
+  local o1, o2 = setmetatable({n = 0}, C), setmetatable({n = 5}, C)
+  for _ = 1, 10 do o1:inc(); o2:inc() end
+  assert(o1.n == 10 and o2.n == 15)
+  o2.inc = function (self) self.n = -1 end   -- shadows class method
+  o1:inc(); o2:inc()
+  assert(o1.n == 11 and o2.n == -1)
+  C.inc = nil    -- method removed from class
+  assert(not pcall(function () o1:inc() end))
+  global X_IC = 1
+  for _ = 1, 10 do X_IC = X_IC + 1 end
+  assert(X_IC == 11)
+  X_IC = nil
+
+  if T then
+    T.icstats()   -- reset counters
+    local p = {x = 1}
+    for _ = 1, 100 do assert(getx(p) == 1) end
+    local hits, misses = T.icstats()
+    assert(hits >= 99 and misses <= 1)
+  end
+end
+
+
+do   print("testing array loops")
+  local function sum (t, i, j, k, s)
+    s = s or 0
+    for n = i, j, k or 1 do s = s + t[n] end
+    return s
+  end
+  local a = {}
+  for i = 1, 100 do a[i] = i end
+  assert(sum(a, 1, #a) == 5050)
+  assert(sum(a, 100, 1, -1) == 5050)
+  assert(sum(a, 1, 100, 3) == 1717)
+  assert(sum(a, 99, 1, -7) == 750)
+  assert(sum(a, 10, 5) == 0 and sum(a, 5, 5) == 5)
+  assert(math.type(sum(a, 1, 100)) == "integer")
+  assert(sum(a, 1, 10, 1, 0.5) == 55.5)
+  -- floats and mixed values
+  local f = {}
+  for i = 1, 10 do f[i] = (i % 2 == 0) and i + 0.5 or i end
+  assert(sum(f, 1, 10) == 57.5 and sum(f, 1, 1) == 1)
+  assert(math.type(sum(f, 1, 1)) == "integer")
+  -- wrap around
+  local w = {math.maxinteger, 1, 1}
+  assert(sum(w, 1, 3) == math.mininteger + 1)
+  -- range beyond the array part
+  local h = {1, 2, 3}
+  h[10] = 10
+  assert(not pcall(sum, h, 1, 10))
+  for i = 4, 9 do h[i] = 0 end
+  assert(sum(h, 1, 10) == 16)
+  -- holes and values that are not numbers
+  local holed = {1, 2, nil, 4}
+  local st, msg = pcall(sum, holed, 1, 4)
+  assert(not st and string.find(msg, "nil"))
+  local t = {1, 2, "3", 4}
+  assert(sum(t, 1, 4) == 10)
+  t[3] = setmetatable({}, {__add = function (a, b) return 100 end})
+  assert(sum(t, 1, 4) == 104)
+  t[3] = {}
+  st, msg = pcall(sum, t, 1, 4)
+  assert(not st and string.find(msg, "table"))
+  -- metamethods in the accumulator
+  local acc = setmetatable({}, {__add = function (a, b) return 7 end})
+  assert(sum(a, 1, 100, 1, acc) == 7 + 5049)
+end
+
 -- testing yield inside __pairs
 do
   local t = setmetatable({10, 20, 30}, {__pairs = function (t)
@@ -466,6 +466,65 @@ do
 end
 
 
+do  print("testing repeated concatenation")
+  local s, pieces, olds = "", {}, {}
+  for i = 1, 2000 do
+    local p = "<" .. i .. ">"
+    pieces[i] = p
+    s = s .. p
+    olds[i] = s
+  end
+  assert(s == table.concat(pieces))
+  for i = 1, 2000, 37 do   -- older strings keep their contents
+    assert(olds[i] == table.concat(pieces, "", 1, i))
+    assert(#olds[i] == #table.concat(pieces, "", 1, i))
+    assert(olds[i] < s and olds[i] <= olds[i + 1])
+    assert(string.sub(s, 1, #olds[i]) == olds[i])
+  end
+
+  -- two concatenations to the same string
+  local base = string.rep("x", 50) .. "y"
+  local a = base .. "a"
+  local b = base .. "b"
+  assert(a == string.rep("x", 50) .. "ya" and b == string.rep("x", 50) .. "yb")
+  assert(base .. base == string.rep(base, 2))
+  assert(base < a and a < b and not (b < base))
+  assert(string.format("%s|", base) == string.rep("x", 50) .. "y|")
+  assert(#base == 51 and string.upper(base) == string.rep("X", 50) .. "Y")
+
+  -- contents handed to C functions are not changed later
+  local c = string.rep("c", 50) .. "!"
+  local t = {}
+  for i = 1, 10 do
+    t[i] = string.gsub(c, "!", function () c = c .. "?"; return "." end)
+  end
+  assert(t[1] == string.rep("c", 50) .. ".")
+  assert(t[10] == string.rep("c", 50) .. "." .. string.rep("?", 9))
+
+  -- strings followed by other contents in their buffer
+  local n = string.rep("0", 50) .. "1"
+  local n1 = n .. "23"
+  assert(n + 0 == 1 and n1 + 0 == 123 and tonumber(n) == 1)
+  assert(string.rep("0", 50) .. "1" == n)
+  local k = {[n] = 1, [n1] = 2}
+  assert(k[string.rep("0", 50) .. "1"] == 1 and k[n .. "23"] == 2)
+
+  local mode = string.rep(" ", 50) .. "k"
+  local other = mode .. "v"
+  local w = setmetatable({}, {__mode = mode})
+  w[{}] = 1; w[1] = {}
+  collectgarbage()
+  assert(next(w) == 1 and next(w, 1) == nil)
+
+  local name = string.rep("N", 50)
+  local name1 = name .. "X"
+  local obj = setmetatable({}, {__name = name})
+  local st, msg = pcall(function () return obj + 1 end)
+  assert(not st and string.find(msg, name .. " value", 1, true))
+  assert(#other == 52 and #name1 == 51)
+end
+
+
 if T==nil then
   (Message or print)
      ("\n >>> testC not active: skipping 'pushfstring' tests <<<\n")
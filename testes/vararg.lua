@@ -256,5 +256,34 @@ do   -- access to vararg parameter
   assert(foo(10, 30) == 20)
 end
 
+
+do   -- varargs near the stack limit and in deep recursion
+  local function id (...) return ... end
+  local function rec (n, a, ...)
+    if n == 0 then return select('#', ...), a, ... end
+    return rec(n - 1, a + 1, n, ...)
+  end
+  local t = table.pack(rec(500, 0))
+  assert(t.n == 502 and t[1] == 500 and t[2] == 500)
+  for i = 3, t.n do assert(t[i] == i - 2) end
+  -- many extra arguments, so that 'VARARG' needs to grow the stack
+  local lim = 5000
+  t = table.pack(id(table.unpack({}, 1, lim)))
+  assert(t.n == lim and t[lim] == nil)
+  local function first3 (...) local a, b, c, d = ...; return a, b, c, d end
+  local a, b, c, d = first3(1, 2)
+  assert(a == 1 and b == 2 and c == nil and d == nil)
+  a, b, c, d = first3(1, 2, 3, 4, 5)
+  assert(a == 1 and b == 2 and c == 3 and d == 4)
+  local co = coroutine.wrap(function (...)
+    local n = select('#', ...)
+    local x, y = coroutine.yield(...)
+    return n, x, y, ...
+  end)
+  assert(co(1, 2, 3) == 1)
+  local n, x, y, p, q, r = co(4, 5)
+  assert(n == 3 and x == 4 and y == 5 and p == 1 and q == 2 and r == 3)
+end
+
 print('OK')
 